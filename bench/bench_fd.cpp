@@ -0,0 +1,318 @@
+// Strong and weak scaling benchmark of the finite-difference solvers
+//
+// Usage: mpirun -n <P> bench_fd [--scaling=strong|weak|both] [--format=csv|json] [--output=file|-]
+//                                [--work=2e7]     (or positionally in this order, see config.hpp)
+//                                [--strong_sizes=256,1024] [--weak_sizes=128,256] [--nghost=1,2,4]
+//                                [--modes=packed,datatype] [--solvers=jacobi,cg,pipecg,mg]
+// The lists select the configurations: grid sizes per scaling mode, the ghost depths of Jacobi
+// (temporal blocking beyond 1; the other solvers use 1), the halo modes and the solvers
+// (mg runs once, with the first mode).
+// Every configuration (solver, halo mode, ghost depth, grid size) runs on the first p ranks
+// for p = 1, 2, 4, ... and P, on a sub-communicator split off MPI_COMM_WORLD:
+//  strong - the global grid is fixed (N x N), the local grids shrink with p
+//  weak   - the local grid is fixed (about n x n per rank), the global grid grows with p
+// Each run does a fixed number of iterations (about `work` cell updates on one rank) after a
+// warm-up, and the halo exchange of the same decomposition is timed on its own. Rank 0 writes
+// one record per run with the slowest rank's time per iteration, the halo time and bandwidth,
+// the cell update rate and the parallel efficiency relative to p = 1
+// (strong: t1 / (p tp), weak: t1 / tp) as CSV or JSON, to stdout or output_file.
+#include <mpi.h>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cg.hpp"
+#include "config.hpp"
+#include "decomp2d.hpp"
+#include "field2d.hpp"
+#include "haloExchange.hpp"
+#include "multigrid.hpp"
+#include "parallel.hpp"
+#include "pipelinedCG.hpp"
+#include "poisson2d.hpp"
+#include "temporalJacobi.hpp"
+
+struct Case {
+  const char *scaling; // "strong" or "weak"
+  int n; // global (strong) or per-rank (weak) grid size
+  const char *solver; // "jacobi", "cg", "pipecg" or "mg"
+  HaloMode mode;
+  int nghost;
+};
+
+struct Result {
+  Case config;
+  int ranks, Px, Py, Nx, Ny, iterations;
+  double time; // seconds per iteration, slowest rank
+  double halo_time; // seconds per halo exchange, slowest rank
+  double halo_bytes; // bytes sent per exchange, busiest rank
+  double efficiency;
+};
+
+static const char *mode_name(HaloMode mode) { return mode == HaloMode::Packed ? "packed" : "datatype"; }
+
+// Bytes this rank sends in one exchange of halo on decomp
+static double halo_bytes(const Decomp2D &decomp, const HaloExchange<float> &halo) {
+  const int ng = decomp.nghost();
+  const int row_len = halo.corners() ? decomp.nx() + 2*ng : decomp.nx();
+  double values = 0.0;
+  if(decomp.left() != MPI_PROC_NULL) values += ng * decomp.ny();
+  if(decomp.right() != MPI_PROC_NULL) values += ng * decomp.ny();
+  if(decomp.down() != MPI_PROC_NULL) values += ng * row_len;
+  if(decomp.up() != MPI_PROC_NULL) values += ng * row_len;
+  return values * sizeof(float);
+}
+
+// Slowest rank's average time of one call of step() after a warm-up
+template <typename Step>
+static double time_steps(MPI_Comm comm, int warmup, int iters, Step step) {
+  for(int it = 0; it < warmup; ++it) step();
+  MPI_Barrier(comm);
+  double t0 = MPI_Wtime();
+  for(int it = 0; it < iters; ++it) step();
+  double local_time = (MPI_Wtime() - t0) / iters;
+  double time = 0.0;
+  MPI_Allreduce(&local_time, &time, 1, MPI_DOUBLE, MPI_MAX, comm);
+  return time;
+}
+
+// One configuration on all ranks of comm; the result is complete on rank 0 of comm
+static Result run(MPI_Comm comm, const Case &config, double work) {
+  int p;
+  MPI_Comm_size(comm, &p);
+  Result result{};
+  result.config = config;
+  result.ranks = p;
+
+  // grids of 2^k + 1 points keep the full multigrid hierarchy
+  int Px = 0, Py = 0, Nx, Ny;
+  if(std::strcmp(config.scaling, "strong") == 0) {
+    Nx = Ny = config.n + 1;
+    Decomp2D::choose_grid(p, Nx, Ny, Px, Py);
+  }
+  else {
+    Decomp2D::choose_grid(p, config.n * p, config.n * p, Px, Py);
+    Nx = config.n * Px + 1;
+    Ny = config.n * Py + 1;
+  }
+  Decomp2D decomp(comm, Nx, Ny, Px, Py, config.nghost);
+  result.Px = Px;
+  result.Py = Py;
+  result.Nx = Nx;
+  result.Ny = Ny;
+
+  // the same iteration count for every p of a configuration (set by the grid on one rank)
+  const double cells = static_cast<double>(config.n + 1) * (config.n + 1);
+  const bool mg = std::strcmp(config.solver, "mg") == 0;
+  const int iters = std::max(5, std::min(5000, static_cast<int>(work / cells / (mg ? 10 : 1))));
+  result.iterations = iters;
+
+  const float hx = 1.0f / (Nx - 1), hy = 1.0f / (Ny - 1);
+  Field2D<float> u(decomp), u_new(decomp), f(decomp);
+  // f = 1, which excites all modes: sin(pi x) sin(pi y) is an eigenvector, CG would solve it in
+  // one iteration and spend the rest on rounding noise (and the pipelined variant on restarts)
+  f.fill(1.0f);
+  const bool deep = std::strcmp(config.solver, "jacobi") == 0 && config.nghost > 1;
+
+  if(std::strcmp(config.solver, "jacobi") == 0 && deep) {
+    TemporalJacobi<float> temporal(decomp, hx, hy, config.mode);
+    temporal.exchange_rhs(f);
+    // one call does nghost sweeps
+    const int calls = std::max(1, iters / config.nghost);
+    result.time = time_steps(comm, 2, calls, [&] { temporal.smooth(u, f, u_new); }) / config.nghost;
+    result.iterations = calls * config.nghost;
+  }
+  else if(std::strcmp(config.solver, "jacobi") == 0) {
+    Poisson2D<float> A(decomp, hx, hy, config.mode);
+    result.time = time_steps(comm, 5, iters, [&] {
+      A.jacobi(u, f, u_new);
+      std::swap(u, u_new);
+    });
+  }
+  else if(std::strcmp(config.solver, "cg") == 0) {
+    Poisson2D<float> A(decomp, hx, hy, config.mode);
+    CGSolver<float> cg(A);
+    cg.rtol = 0.0; // run all iterations
+    cg.max_iter = iters;
+    SolveStats stats;
+    double time = time_steps(comm, 0, 1, [&] {
+      u.fill(0.0f);
+      stats = cg.solve(f, u);
+    });
+    result.iterations = std::max(stats.iterations, 1);
+    result.time = time / result.iterations;
+  }
+  else if(std::strcmp(config.solver, "pipecg") == 0) {
+    Poisson2D<float> A(decomp, hx, hy, config.mode);
+    PipelinedCGSolver<float> cg(A);
+    cg.rtol = 0.0;
+    cg.max_iter = iters;
+    SolveStats stats;
+    double time = time_steps(comm, 0, 1, [&] {
+      u.fill(0.0f);
+      stats = cg.solve(f, u);
+    });
+    result.iterations = std::max(stats.iterations, 1);
+    result.time = time / result.iterations;
+  }
+  else {
+    // the multigrid levels exchange their halos in packed mode
+    Poisson2D<float> A(decomp, hx, hy, config.mode);
+    Multigrid<float> multigrid(A);
+    multigrid.rtol = 0.0;
+    multigrid.max_iter = iters;
+    multigrid.check_interval = iters; // residual norms only before the first and after the last cycle
+    SolveStats stats;
+    double time = time_steps(comm, 0, 1, [&] {
+      u.fill(0.0f);
+      stats = multigrid.solve(f, u);
+    });
+    result.iterations = std::max(stats.iterations, 1);
+    result.time = time / result.iterations;
+  }
+
+  // the exchange of the solver on its own
+  HaloExchange<float> halo(decomp, config.mode, deep);
+  result.halo_time = time_steps(comm, 10, std::max(iters, 100), [&] { halo.exchange(u); });
+  double bytes = halo_bytes(decomp, halo);
+  MPI_Reduce(&bytes, &result.halo_bytes, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+  return result;
+}
+
+static void write_csv(std::FILE *out, const std::vector<Result> &results, int size) {
+  std::fprintf(out, "# ranks=%d threads=%d\n", size, parallel::max_threads());
+  std::fprintf(out, "scaling,n,solver,mode,nghost,ranks,Px,Py,Nx,Ny,iterations,us_per_iter,halo_us,"
+                    "halo_MB_per_s,Mcells_per_s,efficiency\n");
+  for(const Result &r : results) {
+    const Case &c = r.config;
+    std::fprintf(out, "%s,%d,%s,%s,%d,%d,%d,%d,%d,%d,%d,%.3f,%.3f,%.1f,%.1f,%.3f\n", c.scaling, c.n, c.solver,
+                 mode_name(c.mode), c.nghost, r.ranks, r.Px, r.Py, r.Nx, r.Ny, r.iterations, r.time * 1e6,
+                 r.halo_time * 1e6, r.halo_time > 0.0 ? r.halo_bytes / r.halo_time / 1e6 : 0.0,
+                 static_cast<double>(r.Nx) * r.Ny / r.time / 1e6, r.efficiency);
+  }
+}
+
+static void write_json(std::FILE *out, const std::vector<Result> &results, int size) {
+  std::fprintf(out, "{\n  \"ranks\": %d,\n  \"threads\": %d,\n  \"results\": [\n", size, parallel::max_threads());
+  for(std::size_t k = 0; k < results.size(); ++k) {
+    const Result &r = results[k];
+    const Case &c = r.config;
+    std::fprintf(out, "    {\"scaling\": \"%s\", \"n\": %d, \"solver\": \"%s\", \"mode\": \"%s\", \"nghost\": %d, "
+                      "\"ranks\": %d, \"Px\": %d, \"Py\": %d, \"Nx\": %d, \"Ny\": %d, \"iterations\": %d, "
+                      "\"us_per_iter\": %.3f, \"halo_us\": %.3f, \"halo_MB_per_s\": %.1f, \"Mcells_per_s\": %.1f, "
+                      "\"efficiency\": %.3f}%s\n",
+                 c.scaling, c.n, c.solver, mode_name(c.mode), c.nghost, r.ranks, r.Px, r.Py, r.Nx, r.Ny,
+                 r.iterations, r.time * 1e6, r.halo_time * 1e6,
+                 r.halo_time > 0.0 ? r.halo_bytes / r.halo_time / 1e6 : 0.0,
+                 static_cast<double>(r.Nx) * r.Ny / r.time / 1e6, r.efficiency, k + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+  parallel::init_mpi(&argc, &argv);
+
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  Config options(argc, argv, MPI_COMM_WORLD, {"scaling", "format", "output", "work"});
+  const std::string scaling = options.get_choice("scaling", "both", {"strong", "weak", "both"});
+  const bool json = options.get_choice("format", "csv", {"csv", "json"}) == "json";
+  const std::string output = options.get("output", "-");
+  const double work = options.get_double("work", 2e7);
+  const std::vector<int> strong_sizes = options.get_int_list("strong_sizes", "256,1024");
+  const std::vector<int> weak_sizes = options.get_int_list("weak_sizes", "128,256");
+  const std::vector<int> ghost_depths = options.get_int_list("nghost", "1,2,4");
+  const std::vector<std::string> mode_names = options.get_choice_list("modes", "packed,datatype", {"packed", "datatype"});
+  // the cases point into this list, which lives until the end of main
+  const std::vector<std::string> solvers = options.get_choice_list("solvers", "jacobi,cg,pipecg,mg",
+                                                                   {"jacobi", "cg", "pipecg", "mg"});
+  options.check_unused();
+  const bool strong = scaling != "weak";
+  const bool weak = scaling != "strong";
+
+  for(int nghost : ghost_depths) {
+    if(nghost < 1) {
+      if(rank == 0) std::fprintf(stderr, "Error: nghost = %d, ghost depths must be at least 1\n", nghost);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+  std::vector<HaloMode> modes;
+  for(const std::string &name : mode_names) modes.push_back(name == "datatype" ? HaloMode::Datatype : HaloMode::Packed);
+
+  std::vector<Case> cases;
+  auto add_cases = [&](const char *name, int n) {
+    for(const std::string &solver : solvers) {
+      if(solver == "mg") {
+        cases.push_back({name, n, solver.c_str(), modes.front(), 1});
+        continue;
+      }
+      for(HaloMode mode : modes) {
+        if(solver == "jacobi") for(int nghost : ghost_depths) cases.push_back({name, n, solver.c_str(), mode, nghost});
+        else cases.push_back({name, n, solver.c_str(), mode, 1});
+      }
+    }
+  };
+  if(strong) for(int n : strong_sizes) add_cases("strong", n);
+  if(weak) for(int n : weak_sizes) add_cases("weak", n);
+
+  // 1, 2, 4, ... ranks and all of them
+  std::vector<int> rank_counts;
+  for(int p = 1; p < size; p *= 2) rank_counts.push_back(p);
+  rank_counts.push_back(size);
+
+  std::vector<Result> results;
+  for(std::size_t k = 0; k < rank_counts.size(); ++k) {
+    const int p = rank_counts[k];
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, rank < p ? 0 : MPI_UNDEFINED, rank, &comm);
+    if(comm != MPI_COMM_NULL) {
+      for(const Case &config : cases) {
+        // a strong-scaling grid too small for this many ranks
+        if(std::strcmp(config.scaling, "strong") == 0 && config.n / p < config.nghost) continue;
+        results.push_back(run(comm, config, work));
+      }
+      MPI_Comm_free(&comm);
+    }
+    // the idle ranks wait, so runs on different rank counts do not overlap
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(rank == 0) std::fprintf(stderr, "bench_fd: %d of %d rank counts done\n", static_cast<int>(k) + 1,
+                               static_cast<int>(rank_counts.size()));
+  }
+
+  if(rank == 0) {
+    // efficiency relative to the run of the same configuration on one rank
+    std::map<std::string, double> baseline;
+    auto key = [](const Case &c) {
+      return std::string(c.scaling) + "/" + std::to_string(c.n) + "/" + c.solver + "/" + mode_name(c.mode) + "/" +
+             std::to_string(c.nghost);
+    };
+    for(const Result &r : results) if(r.ranks == 1) baseline[key(r.config)] = r.time;
+    for(Result &r : results) {
+      double t1 = baseline[key(r.config)];
+      bool is_strong = std::strcmp(r.config.scaling, "strong") == 0;
+      r.efficiency = t1 / (is_strong ? r.ranks * r.time : r.time);
+    }
+
+    std::FILE *out = output == "-" ? stdout : std::fopen(output.c_str(), "w");
+    if(!out) {
+      std::fprintf(stderr, "Error: cannot open '%s'\n", output.c_str());
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if(json) write_json(out, results, size);
+    else write_csv(out, results, size);
+    if(out != stdout) {
+      std::fclose(out);
+      std::printf("%d results written to %s\n", static_cast<int>(results.size()), output.c_str());
+    }
+  }
+
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,127 @@
+// Halo exchange benchmark: packed buffers vs. MPI derived datatypes, with and without
+// persistent requests
+//
+// Usage: mpirun -n <P> bench_halo [nghost]
+// For every global grid size all modes are timed on the same decomposition and rank 0
+// prints one CSV line per (N, mode) with the slowest rank's time per exchange.
+#include <mpi.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include "decomp2d.hpp"
+#include "haloExchange.hpp"
+#include "parallel.hpp"
+
+// Fill the interior with a function of the global index and check that every face ghost
+// cell with a neighbour received the neighbour's value. Returns the number of wrong cells.
+static int check_exchange(const Decomp2D &decomp, HaloExchange<float> &halo, bool persistent) {
+  int ng = decomp.nghost();
+  int nx = decomp.nx(), ny = decomp.ny();
+  int stride = ny + 2*ng;
+  std::vector<float> U((nx + 2*ng) * stride, -1.0f);
+  auto value = [&](int gi, int gj) { return static_cast<float>(gi * decomp.Ny() + gj); };
+
+  for(int i = 0; i < nx; ++i)
+    for(int j = 0; j < ny; ++j)
+      U[(i + ng)*stride + j + ng] = value(decomp.i0() + i, decomp.j0() + j);
+
+  if(persistent) PersistentHalo<float>(halo, U).exchange();
+  else halo.exchange(U);
+
+  int wrong = 0;
+  for(int g = 0; g < ng; ++g) {
+    for(int j = 0; j < ny; ++j) {
+      if(decomp.left() != MPI_PROC_NULL && U[g*stride + j + ng] != value(decomp.i0() - ng + g, decomp.j0() + j)) ++wrong;
+      if(decomp.right() != MPI_PROC_NULL && U[(ng + nx + g)*stride + j + ng] != value(decomp.i1() + g, decomp.j0() + j)) ++wrong;
+    }
+    for(int i = 0; i < nx; ++i) {
+      if(decomp.down() != MPI_PROC_NULL && U[(i + ng)*stride + g] != value(decomp.i0() + i, decomp.j0() - ng + g)) ++wrong;
+      if(decomp.up() != MPI_PROC_NULL && U[(i + ng)*stride + ng + ny + g] != value(decomp.i0() + i, decomp.j1() + g)) ++wrong;
+    }
+  }
+  return wrong;
+}
+
+// Slowest rank's average time of one call of exchange()
+template <typename Exchange>
+static double time_exchanges(int iters, Exchange exchange) {
+  for(int it = 0; it < 10; ++it) exchange(); // warm-up
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  double t0 = MPI_Wtime();
+  for(int it = 0; it < iters; ++it) exchange();
+  double local_time = (MPI_Wtime() - t0) / iters;
+
+  double time = 0.0;
+  MPI_Allreduce(&local_time, &time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  return time;
+}
+
+static void report(int N, const char *mode, int iters, double time, double bytes, int wrong, int rank) {
+  double max_bytes = 0.0;
+  MPI_Reduce(&bytes, &max_bytes, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if(rank == 0) {
+    std::printf("%d,%s,%d,%.3f,%.1f,%s\n", N, mode, iters, time * 1e6, max_bytes / time / 1e6,
+                wrong == 0 ? "ok" : "FAILED");
+  }
+}
+
+int main(int argc, char** argv) {
+  parallel::init_mpi(&argc, &argv);
+
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  int nghost = (argc > 1) ? std::atoi(argv[1]) : 1;
+
+  int dims[2] = {0, 0};
+  MPI_Dims_create(size, 2, dims);
+  int Px = dims[0], Py = dims[1];
+
+  const int sizes[] = {64, 128, 256, 512, 1024, 2048, 4096};
+  const HaloMode modes[] = {HaloMode::Packed, HaloMode::Datatype};
+
+  if(rank == 0) {
+    std::printf("# ranks=%d Px=%d Py=%d nghost=%d\n", size, Px, Py, nghost);
+    std::printf("N,mode,iters,us_per_exchange,MB_per_s_per_rank,check\n");
+  }
+
+  for(int N : sizes) {
+    if(N / std::max(Px, Py) < nghost) continue; // a face would be thinner than the ghost depth
+
+    Decomp2D decomp(MPI_COMM_WORLD, N, N, Px, Py, nghost);
+    int nx = decomp.nx(), ny = decomp.ny();
+    std::vector<float> U((nx + 2*nghost) * (ny + 2*nghost), 1.0f);
+
+    // bytes this rank sends per exchange
+    double bytes = 0.0;
+    if(decomp.left() != MPI_PROC_NULL) bytes += nghost * ny * sizeof(float);
+    if(decomp.right() != MPI_PROC_NULL) bytes += nghost * ny * sizeof(float);
+    if(decomp.up() != MPI_PROC_NULL) bytes += nghost * nx * sizeof(float);
+    if(decomp.down() != MPI_PROC_NULL) bytes += nghost * nx * sizeof(float);
+
+    // keep the number of exchanged values per measurement roughly constant
+    int iters = std::max(50, std::min(20000, 4000000 / N));
+
+    for(HaloMode mode : modes) {
+      HaloExchange<float> halo(decomp, mode);
+
+      int wrong[2] = {check_exchange(decomp, halo, false), check_exchange(decomp, halo, true)};
+      int total_wrong[2] = {0, 0};
+      MPI_Allreduce(wrong, total_wrong, 2, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+      const char *name = mode == HaloMode::Packed ? "packed" : "datatype";
+      report(N, name, iters, time_exchanges(iters, [&] { halo.exchange(U); }), bytes, total_wrong[0], rank);
+
+      PersistentHalo<float> persistent(halo, U);
+      std::string persistent_name = std::string(name) + "+persistent";
+      report(N, persistent_name.c_str(), iters, time_exchanges(iters, [&] { persistent.exchange(); }), bytes, total_wrong[1], rank);
+    }
+  }
+
+  MPI_Finalize();
+  return 0;
+}
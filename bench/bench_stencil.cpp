@@ -0,0 +1,129 @@
+// Stencil kernel micro-benchmark with a memory-bandwidth roofline
+//
+// Usage: mpirun -n <P> bench_stencil
+// Every rank runs the same kernels on its own N x N field at the same time (so the node's
+// memory bandwidth is shared as in a real run). For each size, scalar type, instruction set
+// and kernel rank 0 prints the slowest rank's GFLOP/s and GB/s, next to the roofline
+// bound AI * B where B is the per-rank bandwidth of a concurrent STREAM-triad and AI the
+// kernel's arithmetic intensity based on compulsory traffic (incl. write-allocate).
+#include <mpi.h>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include "field2d.hpp"
+#include "stencil.hpp"
+#include "parallel.hpp"
+
+// Per-rank STREAM triad bandwidth in bytes/s, measured with all ranks running concurrently
+static double triad_bandwidth() {
+  const std::size_t n = 1 << 22; // 32 MiB per array, well beyond the last level cache
+  std::vector<double> a(n, 0.0), b(n, 1.0), c(n, 2.0);
+  const double s = 3.0;
+  double best = 1e30;
+  for(int rep = 0; rep < 5; ++rep) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t0 = MPI_Wtime();
+    for(std::size_t k = 0; k < n; ++k) a[k] = b[k] + s * c[k];
+    best = std::min(best, MPI_Wtime() - t0);
+  }
+  volatile double sink = a[n / 2]; // keep the loop alive
+  (void)sink;
+  double local_bw = 4.0 * sizeof(double) * n / best; // read b, c, write a (+ write-allocate)
+  double min_bw = 0.0;
+  MPI_Allreduce(&local_bw, &min_bw, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+  return min_bw;
+}
+
+struct KernelInfo {
+  const char *name;
+  double flops; // per updated point
+  double bytes; // compulsory traffic per updated point, in units of sizeof(T)
+};
+
+// Slowest rank's time of one sweep of kernel k over the interior of an N x N field
+template <typename T>
+static double time_kernel(int k, int N) {
+  Field2D<T> u(N, N, 1), f(N, N, 1), out(N, N, 1);
+  for(int i = 0; i < N; ++i)
+    for(int j = 0; j < N; ++j) {
+      u(i, j) = T(0.001) * ((i * 7 + j * 3) % 17);
+      f(i, j) = T(1);
+    }
+  const Box box = u.interior();
+  const T cx = T(1), cy = T(1);
+
+  auto sweep = [&]() {
+    if(k == 0) stencil::laplacian(u, out, box, cx, cy);
+    else if(k == 1) stencil::residual(u, f, out, box, cx, cy);
+    else stencil::jacobi(u, f, out, box, cx, cy, T(0.8));
+  };
+
+  // calibrate the repetitions to about 0.1 s
+  int reps = 1;
+  for(;;) {
+    double t0 = MPI_Wtime();
+    for(int r = 0; r < reps; ++r) sweep();
+    double t = MPI_Wtime() - t0, t_max = 0.0;
+    MPI_Allreduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    if(t_max > 0.1 || reps >= (1 << 20)) break;
+    reps *= 2;
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  double t0 = MPI_Wtime();
+  for(int r = 0; r < reps; ++r) sweep();
+  double t = (MPI_Wtime() - t0) / reps, t_max = 0.0;
+  MPI_Allreduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  return t_max;
+}
+
+template <typename T>
+static void run(const char *type_name, int N, double bandwidth, int rank) {
+  const KernelInfo kernels[] = {
+    {"laplacian", 8.0, 3.0},  // read u, write y
+    {"residual", 9.0, 4.0},   // read u, f, write r
+    {"jacobi", 10.0, 4.0},    // read u, f, write u_new (max-change reduction not counted)
+  };
+  const stencil::Isa isas[] = {stencil::Isa::Scalar, stencil::Isa::AVX2, stencil::Isa::AVX512};
+
+  for(stencil::Isa isa : isas) {
+    if(!stencil::set_isa(isa)) continue;
+    for(int k = 0; k < 3; ++k) {
+      double t = time_kernel<T>(k, N);
+      double points = static_cast<double>(N) * N;
+      double gflops = kernels[k].flops * points / t / 1e9;
+      double gbs = kernels[k].bytes * sizeof(T) * points / t / 1e9;
+      double ai = kernels[k].flops / (kernels[k].bytes * sizeof(T));
+      double roof = ai * bandwidth / 1e9;
+      if(rank == 0) {
+        std::printf("%d,%s,%s,%s,%.3f,%.2f,%.2f,%.3f,%.2f,%.0f\n", N, type_name, stencil::isa_name(isa),
+                    kernels[k].name, t * 1e6, gflops, gbs, ai, roof, 100.0 * gflops / roof);
+      }
+    }
+  }
+  stencil::set_isa(stencil::best_isa());
+}
+
+int main(int argc, char** argv) {
+  parallel::init_mpi(&argc, &argv);
+
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  double bandwidth = triad_bandwidth();
+  if(rank == 0) {
+    std::printf("# ranks=%d best_isa=%s triad_bandwidth_per_rank=%.2f GB/s\n", size,
+                stencil::isa_name(stencil::best_isa()), bandwidth / 1e9);
+    std::printf("N,type,isa,kernel,us_per_sweep,GFLOP_s,GB_s,flop_per_byte,roofline_GFLOP_s,pct_of_roofline\n");
+  }
+
+  const int sizes[] = {64, 256, 1024, 4096};
+  for(int N : sizes) {
+    run<float>("float", N, bandwidth, rank);
+    run<double>("double", N, bandwidth, rank);
+  }
+
+  MPI_Finalize();
+  return 0;
+}
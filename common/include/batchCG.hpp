@@ -0,0 +1,121 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "batchField2d.hpp"
+#include "batchFieldOps.hpp"
+#include "batchPoisson2d.hpp"
+#include "profiler.hpp"
+#include "solver.hpp"
+
+
+// Batched Conjugate Gradient: B independent CG iterations for A x_b = b_b, b = 0 .. B-1, with
+// A = BatchPoisson2D, advanced together. Each member keeps its own step lengths, so every one
+// follows exactly the iterates of CGSolver without preconditioner, but the work is shared: one
+// halo exchange per iteration for all members, one pass over the interleaved fields per vector
+// update, and two MPI_Allreduce of B values per iteration, <p, A p> and <r, r> of all members,
+// instead of 2 B reductions. A member that has converged is frozen (zero step) while the
+// others continue, so its residual stays where it was.
+//
+// There is no preconditioner: Jacobi is a scalar multiple of the identity for this operator
+// and leaves the CG iterates unchanged.
+template <typename T>
+class BatchCGSolver
+{
+    BatchPoisson2D<T> &A_;
+    BatchField2D<T> r_, p_, q_;
+    std::vector<double> residuals_;
+    std::vector<int> iterations_;
+
+public:
+    int max_iter = 10000;
+    double rtol = 1e-8; // a member stops when ||r_b|| <= rtol * ||b_b||
+    int verbose = 0; // rank 0 prints the largest residual every `verbose` iterations (0: silent)
+
+    explicit BatchCGSolver(BatchPoisson2D<T> &A)
+        : A_(A), r_(A.decomp(), A.batch()), p_(A.decomp(), A.batch()), q_(A.decomp(), A.batch()),
+          residuals_(A.batch(), 0.0), iterations_(A.batch(), 0) {}
+
+    // Solve A x_b = b_b for all members, x holds the initial guesses on entry. The stats are
+    // those of the batch: iterations until the last member stopped, the largest relative
+    // residual, converged when all members are; residual(b) and iterations(b) give each member's.
+    SolveStats solve(const BatchField2D<T> &b, BatchField2D<T> &x) {
+        const Box &box = A_.box();
+        const int nb = A_.batch();
+        SolveStats stats;
+
+        std::vector<double> norm_b(nb), rr(nb), pq(nb), rr_new(nb);
+        std::vector<T> alpha(nb), neg_alpha(nb), beta(nb);
+        std::vector<char> active(nb, 1);
+        std::fill(iterations_.begin(), iterations_.end(), 0);
+        reduce_dots(b, b, norm_b.data());
+        for (int m = 0; m < nb; ++m) {
+            norm_b[m] = std::sqrt(norm_b[m]);
+            if (norm_b[m] == 0.0) zero_member(x, m);
+        }
+
+        // r = b - A x, p = r
+        A_.residual(x, b, r_);
+        batchops::copy(r_, p_, box);
+        reduce_dots(r_, r_, rr.data());
+
+        for (int iter = 0; ; ++iter) {
+            int num_active = 0;
+            for (int m = 0; m < nb; ++m) {
+                residuals_[m] = norm_b[m] > 0.0 ? std::sqrt(rr[m]) / norm_b[m] : 0.0;
+                if (residuals_[m] <= rtol) active[m] = 0;
+                num_active += active[m];
+            }
+            if (num_active == 0 || iter == max_iter) break;
+            if (verbose > 0 && iter % verbose == 0 && A_.decomp().rank() == 0) {
+                std::printf("Batched CG iteration %d: %d of %d members active, largest relative residual = %e\n",
+                            iter, num_active, nb, *std::max_element(residuals_.begin(), residuals_.end()));
+            }
+
+            A_.apply(p_, q_);
+            reduce_dots(p_, q_, pq.data());
+            for (int m = 0; m < nb; ++m) {
+                if (active[m] && !(pq[m] > 0.0)) active[m] = 0; // breakdown: p in the null space of a singular A
+                alpha[m] = active[m] ? static_cast<T>(rr[m] / pq[m]) : T(0);
+                neg_alpha[m] = -alpha[m];
+            }
+            batchops::axpy(alpha.data(), p_, x, box);
+            batchops::axpy(neg_alpha.data(), q_, r_, box);
+
+            reduce_dots(r_, r_, rr_new.data());
+            for (int m = 0; m < nb; ++m) {
+                beta[m] = active[m] ? static_cast<T>(rr_new[m] / rr[m]) : T(0);
+                if (active[m]) {
+                    rr[m] = rr_new[m];
+                    ++iterations_[m];
+                }
+            }
+            batchops::xpay(r_, beta.data(), p_, box); // p = r + beta p
+            stats.iterations = iter + 1;
+        }
+        stats.residual = *std::max_element(residuals_.begin(), residuals_.end());
+        stats.converged = stats.residual <= rtol;
+        return stats;
+    }
+
+    // Final relative residual and iterations of member b of the last solve
+    double residual(int b) const { return residuals_[b]; }
+    int iterations(int b) const { return iterations_[b]; }
+
+private:
+    // Global <a_b, b_b> of all members in one reduction (timed separately from the vector work)
+    void reduce_dots(const BatchField2D<T> &a, const BatchField2D<T> &b, double *sums) const {
+        batchops::local_dots(a, b, A_.box(), sums);
+        PDE_PROFILE_SCOPE("cg.allreduce");
+        MPI_Allreduce(MPI_IN_PLACE, sums, A_.batch(), MPI_DOUBLE, MPI_SUM, A_.comm());
+    }
+
+    void zero_member(BatchField2D<T> &x, int m) const {
+        const Box &box = A_.box();
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            for (int j = box.j_begin; j < box.j_end; ++j) x(i, j, m) = T(0);
+        }
+    }
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include "decomp2d.hpp"
+#include "field2d.hpp"
+#include "parallel.hpp"
+
+
+// B ghost-padded 2D fields on the same Decomp2D, stored interleaved: the B values of a cell are
+// contiguous, so value (i, j) of member b lives at (i + nghost) * stride + (j + nghost) * B + b
+// with stride = (ny + 2*nghost) * B. An x-layer is then one contiguous row of (ny + 2*nghost) * B
+// values in which the y-neighbours of a value are B positions away: the stencil kernels run
+// along it like along a Field2D row and vectorise across the batch, and a face of the halo
+// carries all members in one message (HaloExchange with components = B). With B = 1 the layout
+// is the one of Field2D.
+template <typename T>
+class BatchField2D
+{
+public:
+    static constexpr std::size_t alignment = Field2D<T>::alignment;
+
+private:
+    struct AlignedFree { void operator()(T *p) const { std::free(p); } };
+
+    int nx_, ny_, nghost_, batch_;
+    int i0_, j0_; // global index of the first owned cell
+    int stride_; // distance between two consecutive x-layers
+    std::size_t size_; // number of values including ghost cells
+    std::unique_ptr<T[], AlignedFree> data_;
+
+public:
+    BatchField2D(int nx, int ny, int nghost, int batch, int i0 = 0, int j0 = 0)
+        : nx_(nx), ny_(ny), nghost_(nghost), batch_(batch), i0_(i0), j0_(j0), stride_((ny + 2*nghost) * batch),
+          size_(static_cast<std::size_t>(nx + 2*nghost) * stride_)
+    {
+        std::size_t bytes = size_ * sizeof(T);
+        bytes = (bytes + alignment - 1) / alignment * alignment; // aligned_alloc needs a multiple of the alignment
+        T *p = static_cast<T*>(std::aligned_alloc(alignment, std::max(bytes, alignment)));
+        if (!p) throw std::bad_alloc();
+        data_.reset(p);
+        fill(T(0));
+    }
+
+    BatchField2D(const Decomp2D &decomp, int batch)
+        : BatchField2D(decomp.nx(), decomp.ny(), decomp.nghost(), batch, decomp.i0(), decomp.j0()) {}
+
+    BatchField2D(BatchField2D&&) noexcept = default;
+    BatchField2D& operator=(BatchField2D&&) noexcept = default;
+
+    // Member b of local cell (i, j), indices as for Field2D
+    T& operator()(int i, int j, int b) { return data_[index(i, j) + b]; }
+    const T& operator()(int i, int j, int b) const { return data_[index(i, j) + b]; }
+
+    // Position of member 0 of local cell (i, j) in the padded buffer
+    std::size_t index(int i, int j) const {
+        return static_cast<std::size_t>(i + nghost_) * stride_ + static_cast<std::size_t>(j + nghost_) * batch_;
+    }
+
+    // Pointer to member 0 of cell (i, j); the row continues with the members of (i, j + 1) etc.
+    T* row(int i, int j = 0) { return data_.get() + index(i, j); }
+    const T* row(int i, int j = 0) const { return data_.get() + index(i, j); }
+
+    // Threaded by x-layers like the kernels (first touch)
+    void fill(T value) {
+        const int layers = nx_ + 2*nghost_;
+        T *p = data_.get();
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(size_) >= parallel::min_parallel))
+        for (int l = 0; l < layers; ++l) {
+            std::fill(p + static_cast<std::size_t>(l) * stride_, p + static_cast<std::size_t>(l + 1) * stride_, value);
+        }
+    }
+
+    // Copy member b from / to a Field2D on the same decomposition (owned cells only)
+    void set_member(int b, const Field2D<T> &f) {
+        for (int i = 0; i < nx_; ++i) {
+            const T *pf = f.row(i);
+            T *p = row(i);
+            for (int j = 0; j < ny_; ++j) p[static_cast<std::size_t>(j) * batch_ + b] = pf[j];
+        }
+    }
+
+    void get_member(int b, Field2D<T> &f) const {
+        for (int i = 0; i < nx_; ++i) {
+            const T *p = row(i);
+            T *pf = f.row(i);
+            for (int j = 0; j < ny_; ++j) pf[j] = p[static_cast<std::size_t>(j) * batch_ + b];
+        }
+    }
+
+    int global_i(int i) const { return i0_ + i; }
+    int global_j(int j) const { return j0_ + j; }
+
+    Box interior() const { return {0, nx_, 0, ny_}; }
+
+    T* data() { return data_.get(); }
+    const T* data() const { return data_.get(); }
+    std::size_t size() const { return size_; }
+    int stride() const { return stride_; }
+    int nx() const { return nx_; }
+    int ny() const { return ny_; }
+    int nghost() const { return nghost_; }
+    int batch() const { return batch_; }
+    int i0() const { return i0_; }
+    int j0() const { return j0_; }
+};
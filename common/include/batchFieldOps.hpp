@@ -0,0 +1,105 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <vector>
+#include "batchField2d.hpp"
+#include "parallel.hpp"
+
+
+// fieldops for BatchField2D: the same BLAS-1 operations restricted to a Box, done for all
+// members in one pass over the interleaved storage. Scalars are per member (arrays of batch
+// values) and the reductions return one value per member, all of them in a single
+// MPI_Allreduce, so a batch costs the latency of one reduction.
+namespace batchops
+{
+
+namespace detail
+{
+
+// Per-member scalars repeated along an interleaved row of n values (n a multiple of the batch):
+// the element-wise loops then run over the contiguous row and vectorise, instead of an inner
+// loop of B iterations per cell
+template <typename T>
+std::vector<T> expand(const T *values, int batch, int n) {
+    std::vector<T> row(n);
+    for (int k = 0; k < n; ++k) row[k] = values[k % batch];
+    return row;
+}
+
+} // namespace detail
+
+// Local parts of <a_b, b_b> for every member b into sums[0 .. batch) (no communication). Each
+// thread accumulates one partial sum per position of a row and folds them into the members at
+// the end.
+template <typename T>
+void local_dots(const BatchField2D<T> &a, const BatchField2D<T> &b, const Box &box, double *sums) {
+    const int nb = a.batch();
+    const int n = (box.j_end - box.j_begin) * nb;
+    std::fill(sums, sums + nb, 0.0);
+    PDE_OMP(parallel if(box.count() * nb >= parallel::min_parallel))
+    {
+        std::vector<double> part(n, 0.0);
+        double *acc = part.data();
+        PDE_OMP(for schedule(static))
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            const T *pa = a.row(i, box.j_begin), *pb = b.row(i, box.j_begin);
+            for (int k = 0; k < n; ++k) acc[k] += static_cast<double>(pa[k]) * pb[k];
+        }
+        PDE_OMP(critical)
+        for (int k = 0; k < n; ++k) sums[k % nb] += acc[k];
+    }
+}
+
+// Global <a_b, b_b> of every member over the boxes of all ranks of comm (one reduction)
+template <typename T>
+void dots(const BatchField2D<T> &a, const BatchField2D<T> &b, const Box &box, MPI_Comm comm, double *sums) {
+    local_dots(a, b, box, sums);
+    MPI_Allreduce(MPI_IN_PLACE, sums, a.batch(), MPI_DOUBLE, MPI_SUM, comm);
+}
+
+// y_b += alpha[b] * x_b
+template <typename T>
+void axpy(const T *alpha, const BatchField2D<T> &x, BatchField2D<T> &y, const Box &box) {
+    const int n = (box.j_end - box.j_begin) * x.batch();
+    const std::vector<T> coef = detail::expand(alpha, x.batch(), n);
+    const T *c = coef.data();
+    PDE_OMP(parallel for schedule(static) if(box.count() * x.batch() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const T *px = x.row(i, box.j_begin);
+        T *py = y.row(i, box.j_begin);
+        for (int k = 0; k < n; ++k) py[k] += c[k] * px[k];
+    }
+}
+
+// y_b = x_b + beta[b] * y_b
+template <typename T>
+void xpay(const BatchField2D<T> &x, const T *beta, BatchField2D<T> &y, const Box &box) {
+    const int n = (box.j_end - box.j_begin) * x.batch();
+    const std::vector<T> coef = detail::expand(beta, x.batch(), n);
+    const T *c = coef.data();
+    PDE_OMP(parallel for schedule(static) if(box.count() * x.batch() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const T *px = x.row(i, box.j_begin);
+        T *py = y.row(i, box.j_begin);
+        for (int k = 0; k < n; ++k) py[k] = px[k] + c[k] * py[k];
+    }
+}
+
+// y = x (all members)
+template <typename T>
+void copy(const BatchField2D<T> &x, BatchField2D<T> &y, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() * x.batch() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        std::copy(x.row(i, box.j_begin), x.row(i, box.j_end), y.row(i, box.j_begin));
+    }
+}
+
+template <typename T>
+void set(BatchField2D<T> &y, T value, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() * y.batch() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        std::fill(y.row(i, box.j_begin), y.row(i, box.j_end), value);
+    }
+}
+
+} // namespace batchops
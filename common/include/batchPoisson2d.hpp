@@ -0,0 +1,83 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include "batchField2d.hpp"
+#include "decomp2d.hpp"
+#include "haloExchange.hpp"
+#include "profiler.hpp"
+#include "stencil.hpp"
+
+
+// Poisson2D for a batch of B fields on the same grid (BatchField2D): the same operator
+// A = -Laplacian with homogeneous Dirichlet boundary values, applied to all members at once.
+// One halo exchange moves the faces of all members (HaloExchange with components = B), so a
+// batched apply costs the messages of a single one, and the stencil sweeps the interleaved
+// rows in one pass, vectorised across the batch.
+template <typename T>
+class BatchPoisson2D
+{
+    Decomp2D decomp_;
+    int batch_;
+    HaloExchange<T> halo_;
+    T inv_hx2_, inv_hy2_;
+    Box box_; // unknowns owned by this rank
+    Box inner_; // unknowns whose stencil does not reach into the ghost layers
+    Box strips_[4];
+    int num_strips_;
+
+public:
+    BatchPoisson2D(const Decomp2D &decomp, T hx, T hy, int batch, HaloMode mode = HaloMode::Packed)
+        : decomp_(decomp), batch_(batch), halo_(decomp, mode, false, batch), inv_hx2_(T(1) / (hx * hx)),
+          inv_hy2_(T(1) / (hy * hy))
+    {
+        if (decomp.nghost() < 1 || batch < 1) {
+            if (decomp.rank() == 0) {
+                std::cerr << "Error: BatchPoisson2D needs a decomposition with nghost >= 1 and batch >= 1" << std::endl;
+            }
+            MPI_Abort(decomp.comm(), 1);
+        }
+        box_ = stencil::dirichlet_box(decomp);
+        inner_ = box_.intersect(Box{1, decomp.nx() - 1, 1, decomp.ny() - 1});
+        num_strips_ = box_.subtract(inner_, strips_);
+    }
+
+    // y = A x on the unknowns of every member (updates the ghost layers of x)
+    void apply(BatchField2D<T> &x, BatchField2D<T> &y) {
+        PDE_PROFILE_SCOPE("poisson.apply");
+        halo_.begin(x);
+        stencil::laplacian(x, y, inner_, inv_hx2_, inv_hy2_);
+        halo_.finish(x);
+        for (int s = 0; s < num_strips_; ++s) stencil::laplacian(x, y, strips_[s], inv_hx2_, inv_hy2_);
+    }
+
+    // r = f - A u on the unknowns of every member (updates the ghost layers of u)
+    void residual(BatchField2D<T> &u, const BatchField2D<T> &f, BatchField2D<T> &r) {
+        PDE_PROFILE_SCOPE("poisson.residual");
+        halo_.begin(u);
+        stencil::residual(u, f, r, inner_, inv_hx2_, inv_hy2_);
+        halo_.finish(u);
+        for (int s = 0; s < num_strips_; ++s) stencil::residual(u, f, r, strips_[s], inv_hx2_, inv_hy2_);
+    }
+
+    // One (weighted) Jacobi sweep of every member (updates the ghost layers of u), returns
+    // max |u_new - u| over the unknowns of this rank and all members
+    T jacobi(BatchField2D<T> &u, const BatchField2D<T> &f, BatchField2D<T> &u_new, T omega = T(1)) {
+        PDE_PROFILE_SCOPE("poisson.jacobi");
+        halo_.begin(u);
+        T change = stencil::jacobi(u, f, u_new, inner_, inv_hx2_, inv_hy2_, omega);
+        halo_.finish(u);
+        for (int s = 0; s < num_strips_; ++s) {
+            change = std::max(change, stencil::jacobi(u, f, u_new, strips_[s], inv_hx2_, inv_hy2_, omega));
+        }
+        return change;
+    }
+
+    int batch() const { return batch_; }
+    T inv_hx2() const { return inv_hx2_; }
+    T inv_hy2() const { return inv_hy2_; }
+
+    const Box &box() const { return box_; }
+    const Decomp2D &decomp() const { return decomp_; }
+    MPI_Comm comm() const { return decomp_.comm(); }
+    HaloExchange<T> &halo() { return halo_; }
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <mpi.h>
+#include <cmath>
+#include <cstdio>
+#include "field2d.hpp"
+#include "fieldOps.hpp"
+#include "poisson2d.hpp"
+#include "profiler.hpp"
+#include "solver.hpp"
+
+
+// Distributed matrix-free preconditioned Conjugate Gradient for A x = b with A = Poisson2D.
+// Two global reductions per iteration: <p, A p>, and <r, r> fused with <r, z>.
+// Without a preconditioner (nullptr) this is plain CG.
+template <typename T>
+class CGSolver
+{
+    Poisson2D<T> &A_;
+    Preconditioner<T> *M_;
+    Field2D<T> r_, z_, p_, q_;
+
+public:
+    int max_iter = 10000;
+    double rtol = 1e-8; // stop when ||r|| <= rtol * ||b||
+    int verbose = 0; // rank 0 prints the residual every `verbose` iterations (0: silent)
+
+    CGSolver(Poisson2D<T> &A, Preconditioner<T> *M = nullptr)
+        : A_(A), M_(M), r_(A.decomp()), z_(A.decomp()), p_(A.decomp()), q_(A.decomp()) {}
+
+    // Solve A x = b, x holds the initial guess on entry
+    SolveStats solve(const Field2D<T> &b, Field2D<T> &x) {
+        const Box &box = A_.box();
+        MPI_Comm comm = A_.comm();
+        SolveStats stats;
+
+        double norm_b = fieldops::norm2(b, box, comm);
+        if (norm_b == 0.0) {
+            fieldops::set(x, T(0), box);
+            stats.converged = true;
+            return stats;
+        }
+
+        // r = b - A x, z = M r, p = z
+        A_.residual(x, b, r_);
+        precondition(r_, z_);
+        fieldops::copy(z_, p_, box);
+
+        double sums[2] = {fieldops::local_dot(r_, r_, box), fieldops::local_dot(r_, z_, box)};
+        reduce(sums, 2, comm);
+        double rr = sums[0], rz = sums[1];
+
+        for (int iter = 0; iter < max_iter; ++iter) {
+            stats.residual = std::sqrt(rr) / norm_b;
+            if (stats.residual <= rtol) {
+                stats.converged = true;
+                break;
+            }
+            if (verbose > 0 && iter % verbose == 0 && A_.decomp().rank() == 0) {
+                std::printf("CG iteration %d: relative residual = %e\n", iter, stats.residual);
+            }
+
+            A_.apply(p_, q_);
+            double pq = reduce_dot(p_, q_, box, comm);
+            if (!(pq > 0.0)) break; // breakdown: p in the null space of a singular (periodic) A
+            T alpha = static_cast<T>(rz / pq);
+            fieldops::axpy(alpha, p_, x, box);
+            fieldops::axpy(-alpha, q_, r_, box);
+
+            precondition(r_, z_);
+            sums[0] = fieldops::local_dot(r_, r_, box);
+            sums[1] = fieldops::local_dot(r_, z_, box);
+            reduce(sums, 2, comm);
+            double rz_new = sums[1];
+            rr = sums[0];
+
+            T beta = static_cast<T>(rz_new / rz);
+            rz = rz_new;
+            fieldops::xpay(z_, beta, p_, box); // p = z + beta p
+            stats.iterations = iter + 1;
+        }
+        if (!stats.converged) stats.residual = std::sqrt(rr) / norm_b;
+        return stats;
+    }
+
+private:
+    // Global sums of the local values (timed separately from the vector work)
+    static void reduce(double *sums, int n, MPI_Comm comm) {
+        PDE_PROFILE_SCOPE("cg.allreduce");
+        MPI_Allreduce(MPI_IN_PLACE, sums, n, MPI_DOUBLE, MPI_SUM, comm);
+    }
+
+    static double reduce_dot(const Field2D<T> &a, const Field2D<T> &b, const Box &box, MPI_Comm comm) {
+        double sum = fieldops::local_dot(a, b, box);
+        reduce(&sum, 1, comm);
+        return sum;
+    }
+
+    void precondition(const Field2D<T> &r, Field2D<T> &z) {
+        PDE_PROFILE_SCOPE("cg.precondition");
+        if (M_) M_->apply(r, z);
+        else fieldops::copy(r, z, A_.box());
+    }
+};
@@ -0,0 +1,246 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "field2d.hpp"
+#include "fieldOps.hpp"
+#include "poisson2d.hpp"
+#include "profiler.hpp"
+#include "solver.hpp"
+
+
+// Chebyshev semi-iteration for A x = b with A = Poisson2D, applied to the Jacobi scaled system
+// D^{-1} A x = D^{-1} b (Chebyshev-accelerated Jacobi). With the spectrum of D^{-1} A inside
+// [lower, upper] the iterates minimise the worst-case error over that interval, like CG does
+// for the actual spectrum, but the coefficients follow from the interval alone:
+//   r = b - A x,  x += d,  d = rho_k rho_{k-1} d + 2 rho_k / delta D^{-1} r
+// Each step is one halo exchange and one stencil sweep, without any global reduction.
+//
+// The interval is the exact spectrum of D^{-1} A by default: Poisson2D has constant
+// coefficients, so its extreme eigenvalues are known in closed form (stencil::jacobi_spectrum).
+// With estimate_steps > 0 the constructor estimates them instead with that many Lanczos steps
+// on D^{-1} A (two reductions per step), the fallback for operators without a closed form: the
+// extreme Ritz values approach the extreme eigenvalues from inside the spectrum. Either way
+// the upper end of the interval keeps a margin of 5% (capped by the Gershgorin bound), as a
+// mode above the interval would grow; in float, rounding moves the top modes out of an exact
+// interval. A lower bound that is too large only slows down the slowest modes, but the
+// estimate converges slowly: resolving lambda_min takes about sqrt(cond) steps.
+//
+// Usable as a solver (solve, which computes the residual norm only every check_interval
+// steps), as a smoother (smooth, a fixed number of steps on the interval set with
+// set_interval, e.g. [upper / 4, upper] to damp the upper part of the spectrum) and as
+// a CG preconditioner (apply, degree steps from a zero initial guess: a fixed polynomial in A,
+// hence symmetric positive definite).
+template <typename T>
+class Chebyshev : public Preconditioner<T>
+{
+    Poisson2D<T> &A_;
+    Field2D<T> r_, d_;
+    T inv_diag_;
+    double lambda_min_ = 0.0, lambda_max_ = 0.0; // extreme eigenvalues (or Ritz values) of D^{-1} A
+    double lower_ = 0.0, upper_ = 0.0; // interval of the polynomial
+
+public:
+    int degree = 4; // steps of apply()
+    int max_iter = 100000; // steps of solve()
+    double rtol = 1e-8; // solve() stops when ||r|| <= rtol * ||b||
+    int check_interval = 50; // solve() computes the residual norm only every check_interval steps
+    int verbose = 0; // rank 0 prints the residual every `verbose` steps of solve() that are checked (0: silent)
+
+    explicit Chebyshev(Poisson2D<T> &A, int estimate_steps = 0)
+        : A_(A), r_(A.decomp()), d_(A.decomp()), inv_diag_(T(1) / A.diag()) {
+        if (estimate_steps <= 0) {
+            const stencil::Spectrum spectrum = stencil::jacobi_spectrum(A.decomp(), A.inv_hx2(), A.inv_hy2());
+            lambda_min_ = spectrum.lower;
+            lambda_max_ = spectrum.upper;
+        }
+        else {
+            estimate(estimate_steps);
+        }
+        // Gershgorin: |offdiag| sums to the diagonal, so the spectrum of D^{-1} A lies in [0, 2]
+        set_interval(lambda_min_, std::min(1.05 * lambda_max_, 2.0));
+    }
+
+    double lambda_min() const { return lambda_min_; }
+    double lambda_max() const { return lambda_max_; }
+    double lower() const { return lower_; }
+    double upper() const { return upper_; }
+
+    // Interval of the spectrum of D^{-1} A the iteration is tuned for
+    void set_interval(double lower, double upper) {
+        lower_ = lower;
+        upper_ = upper;
+    }
+
+    // Solve A x = b, x holds the initial guess on entry
+    SolveStats solve(const Field2D<T> &b, Field2D<T> &x) {
+        const Box &box = A_.box();
+        MPI_Comm comm = A_.comm();
+        SolveStats stats;
+
+        double norm_b = fieldops::norm2(b, box, comm);
+        if (norm_b == 0.0) {
+            fieldops::set(x, T(0), box);
+            stats.converged = true;
+            return stats;
+        }
+
+        const int interval = std::max(check_interval, 1);
+        double rho = 0.0;
+        A_.residual(x, b, r_);
+        for (int iter = 0; ; ++iter) {
+            // r holds the residual of x; the last step always gets a check so the returned residual is current
+            const bool check = iter % interval == 0 || iter == max_iter;
+            if (check) {
+                stats.residual = fieldops::norm2(r_, box, comm) / norm_b;
+                if (stats.residual <= rtol) {
+                    stats.converged = true;
+                    break;
+                }
+            }
+            if (iter == max_iter) break;
+            if (check && verbose > 0 && iter % verbose == 0 && A_.decomp().rank() == 0) {
+                std::printf("Chebyshev step %d: relative residual = %e\n", iter, stats.residual);
+            }
+            step(x, iter, rho);
+            A_.residual(x, b, r_);
+            stats.iterations = iter + 1;
+        }
+        return stats;
+    }
+
+    // steps Chebyshev steps on A x = b from the initial guess in x (one residual each)
+    void smooth(const Field2D<T> &b, Field2D<T> &x, int steps) {
+        double rho = 0.0;
+        for (int k = 0; k < steps; ++k) {
+            A_.residual(x, b, r_);
+            step(x, k, rho);
+        }
+    }
+
+    // z = p(A) r: degree steps on A z = r from z = 0 (the first residual is r itself)
+    void apply(const Field2D<T> &r, Field2D<T> &z) override {
+        PDE_PROFILE_SCOPE("cheb.apply");
+        const Box &box = A_.box();
+        double rho;
+        first_direction(r, rho);
+        fieldops::copy(d_, z, box);
+        for (int k = 1; k < degree; ++k) {
+            A_.residual(z, r, r_);
+            update_direction(rho);
+            fieldops::axpy(T(1), d_, z, box);
+        }
+    }
+
+private:
+    // Step k of the recurrence with r_ holding the residual of x: update d (and rho), x += d
+    void step(Field2D<T> &x, int k, double &rho) {
+        PDE_PROFILE_SCOPE("cheb.step");
+        if (k == 0) first_direction(r_, rho);
+        else update_direction(rho);
+        fieldops::axpy(T(1), d_, x, A_.box());
+    }
+
+    // d = D^{-1} r / theta, rho_0 = 1 / sigma = delta / theta
+    void first_direction(const Field2D<T> &r, double &rho) {
+        const double theta = 0.5 * (upper_ + lower_), delta = 0.5 * (upper_ - lower_);
+        fieldops::scale(static_cast<T>(1.0 / theta) * inv_diag_, r, d_, A_.box());
+        rho = delta / theta;
+    }
+
+    // d = rho_k rho_{k-1} d + 2 rho_k / delta D^{-1} r with rho_k = 1 / (2 sigma - rho_{k-1})
+    void update_direction(double &rho) {
+        const double theta = 0.5 * (upper_ + lower_), delta = 0.5 * (upper_ - lower_);
+        const double rho_new = 1.0 / (2.0 * theta / delta - rho);
+        fieldops::axpby(static_cast<T>(2.0 * rho_new / delta) * inv_diag_, r_, static_cast<T>(rho_new * rho), d_,
+                        A_.box());
+        rho = rho_new;
+    }
+
+    // Lanczos on the symmetric D^{-1} A (D is a multiple of the identity) from a pseudo-random
+    // start vector that depends on the global index only, so the bounds do not depend on the
+    // process grid. The work fields are freed again.
+    void estimate(int steps) {
+        PDE_PROFILE_SCOPE("cheb.estimate");
+        const Box &box = A_.box();
+        MPI_Comm comm = A_.comm();
+        const Decomp2D &decomp = A_.decomp();
+        Field2D<T> v(decomp), v_prev(decomp), w(decomp);
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            for (int j = box.j_begin; j < box.j_end; ++j) {
+                v(i, j) = start_value(static_cast<std::uint64_t>(v.global_i(i)) * decomp.Ny() + v.global_j(j));
+            }
+        }
+        // constants are in the null space of a fully periodic A: start orthogonal to them
+        if (decomp.periodic_x() && decomp.periodic_y()) {
+            double sums[2] = {0.0, static_cast<double>(box.count())};
+            for (int i = box.i_begin; i < box.i_end; ++i) {
+                for (int j = box.j_begin; j < box.j_end; ++j) sums[0] += v(i, j);
+            }
+            MPI_Allreduce(MPI_IN_PLACE, sums, 2, MPI_DOUBLE, MPI_SUM, comm);
+            const T mean = static_cast<T>(sums[0] / sums[1]);
+            for (int i = box.i_begin; i < box.i_end; ++i) {
+                for (int j = box.j_begin; j < box.j_end; ++j) v(i, j) -= mean;
+            }
+        }
+        fieldops::scale(static_cast<T>(1.0 / fieldops::norm2(v, box, comm)), v, v, box);
+
+        std::vector<double> alpha, beta;
+        for (int k = 0; k < steps; ++k) {
+            // w = D^{-1} A v - alpha v - beta v_prev
+            A_.apply(v, w);
+            fieldops::scale(inv_diag_, w, w, box);
+            alpha.push_back(fieldops::dot(v, w, box, comm));
+            fieldops::axpy(static_cast<T>(-alpha.back()), v, w, box);
+            if (k > 0) fieldops::axpy(static_cast<T>(-beta.back()), v_prev, w, box);
+            const double norm_w = fieldops::norm2(w, box, comm);
+            if (k + 1 == steps || norm_w <= 1e-10 * std::abs(alpha.back())) break; // invariant subspace
+            beta.push_back(norm_w);
+            std::swap(v, v_prev);
+            fieldops::scale(static_cast<T>(1.0 / norm_w), w, v, box);
+        }
+        lambda_min_ = tridiagonal_eigenvalue(alpha, beta, 0);
+        lambda_max_ = tridiagonal_eigenvalue(alpha, beta, static_cast<int>(alpha.size()) - 1);
+    }
+
+    // Eigenvalue number index (ascending) of the symmetric tridiagonal matrix with diagonal
+    // alpha and off-diagonal beta, by bisection on the Sturm sequence count
+    static double tridiagonal_eigenvalue(const std::vector<double> &alpha, const std::vector<double> &beta, int index) {
+        const int n = static_cast<int>(alpha.size());
+        double lo = alpha[0], hi = alpha[0];
+        for (int k = 0; k < n; ++k) {
+            const double radius = (k > 0 ? beta[k - 1] : 0.0) + (k + 1 < n ? beta[k] : 0.0);
+            lo = std::min(lo, alpha[k] - radius);
+            hi = std::max(hi, alpha[k] + radius);
+        }
+        // number of eigenvalues below x
+        auto count_below = [&](double x) {
+            int count = 0;
+            double q = 1.0;
+            for (int k = 0; k < n; ++k) {
+                q = alpha[k] - x - (k > 0 ? beta[k - 1] * beta[k - 1] / q : 0.0);
+                if (q == 0.0) q = 1e-300;
+                if (q < 0.0) ++count;
+            }
+            return count;
+        };
+        for (int it = 0; it < 100 && hi - lo > 1e-14 * std::max(std::abs(lo), std::abs(hi)); ++it) {
+            const double mid = 0.5 * (lo + hi);
+            if (count_below(mid) > index) hi = mid;
+            else lo = mid;
+        }
+        return 0.5 * (lo + hi);
+    }
+
+    // Uniform in [-1, 1) from an integer (splitmix64 finaliser)
+    static T start_value(std::uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return static_cast<T>(static_cast<double>(x >> 11) * (2.0 / 9007199254740992.0) - 1.0);
+    }
+};
@@ -0,0 +1,203 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "decomp2d.hpp"
+#include "field2d.hpp"
+#include "fieldIO.hpp"
+#include "mpiTraits.hpp"
+#include "parallel.hpp"
+
+
+// Solver state stored in a checkpoint besides the field itself
+struct CheckpointState
+{
+    std::int64_t iteration = 0;
+    std::vector<double> history; // e.g. the global residual at every report
+};
+
+// Asynchronous checkpoints of one distributed field plus the solver state, and restart from them.
+//
+// write() copies the owned cells into a staging buffer and starts a non-blocking collective
+// write (MPI_File_iwrite_at_all) into path + ".tmp", so the iterations continue while the field
+// goes to disk; progress() can be called from the loop to drive it. The small header and
+// history are written by rank 0 right away. The next write() or finish() completes the write
+// and renames the file to path, so a job killed while writing keeps the previous checkpoint.
+//
+// File: a header (iteration, history length, and Nx, Ny, Px, Py, nghost, periodicity of the
+// writing decomposition), the history, and at data_offset the Nx x Ny global values in Field2D
+// order. read() takes any decomposition of the same global grid, so a run can restart on a
+// different number of ranks.
+template <typename T>
+class Checkpoint
+{
+public:
+    struct Header
+    {
+        char magic[8]; // "PDECKPT2"
+        std::int32_t version;
+        std::int32_t value_size;
+        std::int32_t Nx, Ny, Px, Py, nghost, periodic_x, periodic_y;
+        std::int32_t reserved;
+        std::int64_t iteration;
+        std::int64_t history_size;
+        std::int64_t data_offset;
+    };
+
+private:
+    static constexpr char magic_[8] = {'P', 'D', 'E', 'C', 'K', 'P', 'T', '2'};
+    static constexpr std::int32_t version_ = 1;
+
+    Decomp2D decomp_;
+    std::string path_;
+    std::vector<T> staging_; // copy of the owned cells being written
+    MPI_Datatype file_type_ = MPI_DATATYPE_NULL;
+    MPI_File fh_ = MPI_FILE_NULL;
+    MPI_Request request_ = MPI_REQUEST_NULL; // write of the field
+    int written_ = 0;
+
+public:
+    Checkpoint(const Decomp2D &decomp, const std::string &path)
+        : decomp_(decomp), path_(path), staging_(static_cast<std::size_t>(decomp.nx()) * decomp.ny())
+    {
+        int global[2] = {decomp.Nx(), decomp.Ny()};
+        int local[2] = {decomp.nx(), decomp.ny()};
+        int start[2] = {decomp.i0(), decomp.j0()};
+        MPI_Type_create_subarray(2, global, local, start, MPI_ORDER_C, mpi_type<T>(), &file_type_);
+        MPI_Type_commit(&file_type_);
+    }
+
+    // The pending write refers to the buffers of this object
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    ~Checkpoint() {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (finalized) return;
+        finish();
+        MPI_Type_free(&file_type_);
+    }
+
+    // Start writing u and state in the background (collective); completes the previous checkpoint first
+    void write(const Field2D<T> &u, const CheckpointState &state) {
+        finish();
+        fieldio::check_field(decomp_, u);
+        MPI_Comm comm = decomp_.comm();
+
+        const int nx = decomp_.nx(), ny = decomp_.ny();
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(nx) * ny >= parallel::min_parallel))
+        for (int i = 0; i < nx; ++i) {
+            std::copy(u.row(i), u.row(i) + ny, staging_.data() + static_cast<std::size_t>(i) * ny);
+        }
+
+        Header header{};
+        std::memcpy(header.magic, magic_, sizeof(magic_));
+        header.version = version_;
+        header.value_size = sizeof(T);
+        header.Nx = decomp_.Nx();
+        header.Ny = decomp_.Ny();
+        header.Px = decomp_.Px();
+        header.Py = decomp_.Py();
+        header.nghost = decomp_.nghost();
+        header.periodic_x = decomp_.periodic_x();
+        header.periodic_y = decomp_.periodic_y();
+        header.iteration = state.iteration;
+        header.history_size = static_cast<std::int64_t>(state.history.size());
+        std::int64_t end = sizeof(Header) + header.history_size * static_cast<std::int64_t>(sizeof(double));
+        header.data_offset = (end + 63) / 64 * 64;
+
+        const std::string tmp = path_ + ".tmp";
+        fieldio::check(MPI_File_open(comm, tmp.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh_),
+                       "opening", tmp, comm);
+        fieldio::check(MPI_File_set_size(fh_, 0), "truncating", tmp, comm);
+        // header and history are small, rank 0 writes them before the view of the field is set
+        // (no non-blocking request may be pending across MPI_File_set_view)
+        if (decomp_.rank() == 0) {
+            fieldio::check(MPI_File_write_at(fh_, 0, &header, sizeof(Header), MPI_BYTE, MPI_STATUS_IGNORE),
+                           "writing", tmp, comm);
+            fieldio::check(MPI_File_write_at(fh_, sizeof(Header), state.history.data(), static_cast<int>(state.history.size()),
+                                             MPI_DOUBLE, MPI_STATUS_IGNORE), "writing", tmp, comm);
+        }
+        char native[] = "native";
+        MPI_File_set_view(fh_, header.data_offset, mpi_type<T>(), file_type_, native, MPI_INFO_NULL);
+        fieldio::check(MPI_File_iwrite_at_all(fh_, 0, staging_.data(), static_cast<int>(staging_.size()), mpi_type<T>(),
+                                              &request_), "writing", tmp, comm);
+    }
+
+    // Let a pending write advance (local, cheap); returns true when there is none left in flight
+    bool progress() {
+        if (fh_ == MPI_FILE_NULL) return true;
+        int done = 0;
+        MPI_Test(&request_, &done, MPI_STATUS_IGNORE);
+        return done;
+    }
+
+    // Complete a pending write and move it into place (collective)
+    void finish() {
+        if (fh_ == MPI_FILE_NULL) return;
+        MPI_Wait(&request_, MPI_STATUS_IGNORE);
+        MPI_File_close(&fh_);
+        // every rank's data is in the file before it replaces the previous checkpoint
+        MPI_Barrier(decomp_.comm());
+        if (decomp_.rank() == 0) {
+            const std::string tmp = path_ + ".tmp";
+            if (std::rename(tmp.c_str(), path_.c_str()) != 0) {
+                std::cerr << "Error: renaming '" << tmp << "' to '" << path_ << "' failed" << std::endl;
+                MPI_Abort(decomp_.comm(), 1);
+            }
+        }
+        MPI_Barrier(decomp_.comm());
+        ++written_;
+    }
+
+    // Number of completed checkpoints
+    int written() const { return written_; }
+    const std::string &path() const { return path_; }
+
+    // Restore u and state from the checkpoint at path, written on any decomposition of the same
+    // global grid (collective). Returns false, leaving u and state untouched, if there is no
+    // checkpoint; header (optional) receives the description of the writing run.
+    static bool read(const std::string &path, const Decomp2D &decomp, Field2D<T> &u, CheckpointState &state,
+                     Header *header = nullptr) {
+        fieldio::check_field(decomp, u);
+        MPI_Comm comm = decomp.comm();
+        MPI_File fh;
+        if (MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) return false;
+
+        Header h{};
+        if (decomp.rank() == 0) {
+            fieldio::check(MPI_File_read_at(fh, 0, &h, sizeof(Header), MPI_BYTE, MPI_STATUS_IGNORE), "reading", path, comm);
+        }
+        MPI_Bcast(&h, sizeof(Header), MPI_BYTE, 0, comm);
+        if (std::memcmp(h.magic, magic_, sizeof(magic_)) != 0 || h.version != version_
+            || h.value_size != static_cast<int>(sizeof(T)) || h.Nx != decomp.Nx() || h.Ny != decomp.Ny()) {
+            if (decomp.rank() == 0) {
+                std::cerr << "Error: '" << path << "' is not a checkpoint of a " << decomp.Nx() << "x" << decomp.Ny()
+                          << " field of " << sizeof(T) << "-byte values" << std::endl;
+            }
+            MPI_Abort(comm, 1);
+        }
+
+        state.iteration = h.iteration;
+        state.history.resize(static_cast<std::size_t>(h.history_size));
+        if (decomp.rank() == 0) {
+            fieldio::check(MPI_File_read_at(fh, sizeof(Header), state.history.data(), static_cast<int>(h.history_size),
+                                            MPI_DOUBLE, MPI_STATUS_IGNORE), "reading", path, comm);
+        }
+        MPI_Bcast(state.history.data(), static_cast<int>(h.history_size), MPI_DOUBLE, 0, comm);
+
+        fieldio::BlockTypes<T> types(decomp, u);
+        char native[] = "native";
+        MPI_File_set_view(fh, h.data_offset, mpi_type<T>(), types.file(), native, MPI_INFO_NULL);
+        fieldio::check(MPI_File_read_all(fh, u.data(), 1, types.memory(), MPI_STATUS_IGNORE), "reading", path, comm);
+        MPI_File_close(&fh);
+        if (header) *header = h;
+        return true;
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <mpi.h>
+#include <cstdio>
+#include <initializer_list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+
+// Run-time options of the drivers, so one binary serves a whole parameter sweep:
+//
+//   poisson_fd --n=1025 --solver=cg --precond=mg --cycle=W --rtol=1e-10
+//   poisson_fd --config=run.cfg --n=2049      (command line overrides the file)
+//
+// Options are `--key=value`, a bare `--key` meaning `--key=true`. `--config=<file>` reads
+// `key = value` lines (`#` starts a comment) at its place in the command line, so later
+// arguments override it. Arguments without `--` are positional and take the keys listed by
+// the driver in order, which keeps the old usage lines working. Rank 0 reads the files and
+// broadcasts the command line, so all ranks see the same options.
+//
+// Every get_*() records the value used (the default when the option was not given);
+// print() lists them for the run log and check_unused() rejects options nobody asked for,
+// so a mistyped key fails loudly instead of silently running the default. Malformed values
+// abort with an error message, like the rest of the code.
+class Config
+{
+    MPI_Comm comm_;
+    int rank_;
+    std::map<std::string, std::string> values_; // as given
+    mutable std::map<std::string, std::string> used_; // as used, defaults included
+    mutable std::set<std::string> asked_;
+
+public:
+    Config(int argc, char **argv, MPI_Comm comm, std::initializer_list<const char*> positional = {});
+
+    bool has(const std::string &key) const;
+
+    std::string get(const std::string &key, const std::string &def) const;
+    int get_int(const std::string &key, int def) const;
+    double get_double(const std::string &key, double def) const;
+    // true / false, 1 / 0, yes / no, on / off; a positional flag may also be given as its own name
+    bool get_bool(const std::string &key, bool def) const;
+    // One of the allowed values (aborts otherwise)
+    std::string get_choice(const std::string &key, const std::string &def,
+                           std::initializer_list<const char*> allowed) const;
+
+    // Comma-separated lists, e.g. --sizes=256,1024 (def in the same form)
+    std::vector<int> get_int_list(const std::string &key, const std::string &def) const;
+    std::vector<std::string> get_choice_list(const std::string &key, const std::string &def,
+                                             std::initializer_list<const char*> allowed) const;
+
+    // Rank 0 prints the options used so far, one `key = value` line each (a valid config file)
+    void print(std::FILE *out = stdout) const;
+    // Abort if an option was given that no get_*() asked for (collective in effect: all ranks
+    // see the same options and fail together)
+    void check_unused() const;
+
+private:
+    void parse_argument(const std::string &arg, int position, const std::vector<std::string> &positional);
+    void parse_file(const std::string &path);
+    void set(const std::string &key, const std::string &value, const std::string &where);
+    [[noreturn]] void fail(const std::string &message) const;
+    const std::string *find(const std::string &key) const;
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <mpi.h>
+#include "profiler.hpp"
+
+
+// How the global value of a convergence check is reduced:
+//  Blocking    - MPI_Allreduce at the check, the result is known immediately
+//  NonBlocking - MPI_Iallreduce started at the check and completed at the next one, so the
+//                reduction overlaps the iterations in between; convergence is detected one
+//                check later than in blocking mode
+enum class ReduceMode { Blocking, NonBlocking };
+
+// Convergence test of an iterative loop on a global value (e.g. max change or squared residual)
+// reduced over all ranks every `interval` iterations instead of every iteration. The loop passes
+// its local value to check() every iteration; only the iterations that are a multiple of the
+// interval take part in a reduction, the others return immediately.
+class ConvergenceMonitor
+{
+    MPI_Comm comm_;
+    double tol_;
+    int interval_;
+    ReduceMode mode_;
+    MPI_Op op_;
+    double send_ = 0.0, recv_ = 0.0; // buffers of the (pending) reduction
+    MPI_Request request_ = MPI_REQUEST_NULL;
+    int pending_iter_ = -1; // iteration of the pending non-blocking reduction
+    double value_ = 0.0; // last completed global value
+    int iteration_ = -1; // iteration of value_ (-1: no reduction completed yet)
+    bool updated_ = false;
+    bool converged_ = false;
+
+public:
+    // Converged once the reduced value (op over all ranks) is <= tol
+    ConvergenceMonitor(MPI_Comm comm, double tol, int interval = 1, ReduceMode mode = ReduceMode::Blocking,
+                       MPI_Op op = MPI_MAX)
+        : comm_(comm), tol_(tol), interval_(interval > 0 ? interval : 1), mode_(mode), op_(op) {}
+
+    // The pending request refers to the buffers of this object
+    ConvergenceMonitor(const ConvergenceMonitor&) = delete;
+    ConvergenceMonitor& operator=(const ConvergenceMonitor&) = delete;
+
+    ~ConvergenceMonitor() {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (!finalized) finish();
+    }
+
+    // Local value of iteration iter; returns true once a completed reduction met the tolerance.
+    // All ranks must call it with the same sequence of iterations.
+    bool check(int iter, double local) {
+        updated_ = false;
+        if (converged_) return true;
+
+        if (mode_ == ReduceMode::Blocking) {
+            if (iter % interval_ != 0) return false;
+            PDE_PROFILE_SCOPE("monitor.allreduce");
+            MPI_Allreduce(&local, &value_, 1, MPI_DOUBLE, op_, comm_);
+            complete(iter);
+            return converged_;
+        }
+
+        // the reduction started at the previous check has had the iterations since to complete
+        if (request_ != MPI_REQUEST_NULL && iter % interval_ == 0) {
+            wait();
+            if (converged_) return true;
+        }
+        if (iter % interval_ == 0) {
+            send_ = local;
+            pending_iter_ = iter;
+            MPI_Iallreduce(&send_, &recv_, 1, MPI_DOUBLE, op_, comm_, &request_);
+        }
+        return false;
+    }
+
+    // Complete a pending reduction (call when leaving the loop early); returns converged()
+    bool finish() {
+        if (request_ != MPI_REQUEST_NULL) wait();
+        return converged_;
+    }
+
+    bool converged() const { return converged_; }
+    // The last check() completed a reduction
+    bool updated() const { return updated_; }
+    // Last completed global value and the iteration it belongs to (-1: none yet)
+    double value() const { return value_; }
+    int iteration() const { return iteration_; }
+    int interval() const { return interval_; }
+    ReduceMode mode() const { return mode_; }
+
+private:
+    void wait() {
+        PDE_PROFILE_SCOPE("monitor.wait");
+        MPI_Wait(&request_, MPI_STATUS_IGNORE);
+        value_ = recv_;
+        complete(pending_iter_);
+    }
+
+    void complete(int iter) {
+        iteration_ = iter;
+        updated_ = true;
+        converged_ = value_ <= tol_;
+    }
+};
@@ -1,11 +1,30 @@
 #pragma once
 #include <mpi.h>
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 
+// Block decomposition of an Nx x Ny grid over a Px x Py process grid. The ranks live in a
+// Cartesian communicator created from the given one (dims {Py, Px}, so px varies fastest), with
+// reordering enabled so MPI can place neighbouring blocks close to each other; copies of a
+// Decomp2D share the communicator, which is freed with the last copy. Axes can be periodic,
+// in which case the first and last ranks along the axis are neighbours.
 class Decomp2D
 {
-    MPI_Comm comm_;
+    // Frees the Cartesian communicator, unless MPI is already finalized
+    struct CommFree {
+        void operator()(MPI_Comm *comm) const {
+            int finalized = 0;
+            MPI_Finalized(&finalized);
+            if (!finalized && *comm != MPI_COMM_NULL) MPI_Comm_free(comm);
+            delete comm;
+        }
+    };
+
+    MPI_Comm comm_; // the Cartesian communicator once constructed
+    std::shared_ptr<MPI_Comm> cart_;
     int Nx_, Ny_; // global grid size
     int Px_, Py_; // process grid size
     int rank_, size_;
@@ -14,9 +33,12 @@ class Decomp2D
     int i0_, i1_, j0_, j1_; // bounds are half open: [i0, i1), [j0, j1)
     int left_, right_, up_, down_;
     int nghost_; // number of ghost cells for communication
+    bool periodic_x_, periodic_y_;
+    std::vector<int> x_splits_, y_splits_; // rank px owns [x_splits[px], x_splits[px+1]), same for y
 
 public:
-    Decomp2D(MPI_Comm comm, int Nx, int Ny, int Px, int Py, int nghost = 0) : comm_(comm), Nx_(Nx), Ny_(Ny), Px_(Px), Py_(Py), nghost_(nghost)
+    Decomp2D(MPI_Comm comm, int Nx, int Ny, int Px, int Py, int nghost = 0, bool periodic_x = false, bool periodic_y = false)
+        : comm_(comm), Nx_(Nx), Ny_(Ny), Px_(Px), Py_(Py), nghost_(nghost), periodic_x_(periodic_x), periodic_y_(periodic_y)
     {
         MPI_Comm_rank(comm_, &rank_);
         MPI_Comm_size(comm_, &size_);
@@ -39,35 +61,294 @@ public:
             MPI_Abort(comm_, 1);
         }
 
-        // Determine the process grid coordinates
-        px_ = rank_ % Px_;
-        py_ = rank_ / Px_;
+        // Compute the splits (handle cases where Nx or Ny is not divisible by Px or Py)
+        x_splits_ = uniform_splits(Nx_, Px_);
+        y_splits_ = uniform_splits(Ny_, Py_);
+
+        init();
+    }
+
+    // Decomposition with given splits: x_splits has Px + 1 entries from 0 to Nx, and the ranks
+    // with px = p own the x-range [x_splits[p], x_splits[p+1]) (likewise in y). Used to align
+    // coarse grids with the partition of a finer grid.
+    Decomp2D(MPI_Comm comm, const std::vector<int> &x_splits, const std::vector<int> &y_splits, int nghost = 0,
+             bool periodic_x = false, bool periodic_y = false)
+        : comm_(comm), Px_(static_cast<int>(x_splits.size()) - 1), Py_(static_cast<int>(y_splits.size()) - 1),
+          nghost_(nghost), periodic_x_(periodic_x), periodic_y_(periodic_y), x_splits_(x_splits), y_splits_(y_splits)
+    {
+        MPI_Comm_rank(comm_, &rank_);
+        MPI_Comm_size(comm_, &size_);
+
+        if (!valid_splits(x_splits_) || !valid_splits(y_splits_))
+        {
+            if (rank_ == 0) {
+                std::cerr << "Error: splits must start at 0, be non-decreasing and end at a positive size" << std::endl;
+            }
+            MPI_Abort(comm_, 1);
+        }
+        Nx_ = x_splits_.back();
+        Ny_ = y_splits_.back();
+
+        // check that the number of processes matches the decomposition
+        if (size_ != Px_ * Py_)
+        {
+            if (rank_ == 0) {
+                std::cerr << "Error: Number of processes must be equal to Px * Py" << std::endl;
+            }
+            MPI_Abort(comm_, 1);
+        }
+
+        init();
+    }
+
+    // Decomposition over all ranks of comm with the process grid chosen by choose_grid
+    static Decomp2D create(MPI_Comm comm, int Nx, int Ny, int nghost = 0, bool periodic_x = false, bool periodic_y = false)
+    {
+        int size;
+        MPI_Comm_size(comm, &size);
+        int Px, Py;
+        choose_grid(size, Nx, Ny, Px, Py, periodic_x, periodic_y);
+        return Decomp2D(comm, Nx, Ny, Px, Py, nghost, periodic_x, periodic_y);
+    }
+
+    // Process grid Px x Py = size for an Nx x Ny grid that minimises the halo volume of the
+    // busiest rank: the largest block (the first ranks get the remainder points) with the
+    // largest number of neighbours. Ties go to the smaller total volume over all ranks.
+    // Grids that would leave ranks without points are skipped unless nothing else fits.
+    static void choose_grid(int size, int Nx, int Ny, int &Px, int &Py, bool periodic_x = false, bool periodic_y = false)
+    {
+        long long best_busy = -1, best_total = -1;
+        Px = size;
+        Py = 1;
+        for (int px = 1; px <= size; ++px) {
+            if (size % px != 0) continue;
+            int py = size / px;
+            if (px > Nx || py > Ny) continue;
+            long long nx_max = (Nx + px - 1) / px;
+            long long ny_max = (Ny + py - 1) / py;
+            // x-neighbours exchange y-faces of ny values, y-neighbours x-faces of nx values
+            long long busy = neighbours(px, periodic_x) * ny_max + neighbours(py, periodic_y) * nx_max;
+            long long total = interfaces(px, periodic_x) * Ny + interfaces(py, periodic_y) * Nx;
+            if (best_busy < 0 || busy < best_busy || (busy == best_busy && total < best_total)) {
+                best_busy = busy;
+                best_total = total;
+                Px = px;
+                Py = py;
+            }
+        }
+    }
+
+    // Load-balanced decomposition for a cost per column (x_weights, Nx entries) and per row
+    // (y_weights, Ny entries): the splits of each axis minimise the largest weight of a part.
+    // Px = Py = 0 picks the process grid with choose_grid.
+    static Decomp2D weighted(MPI_Comm comm, const std::vector<double> &x_weights, const std::vector<double> &y_weights,
+                             int Px = 0, int Py = 0, int nghost = 0, bool periodic_x = false, bool periodic_y = false)
+    {
+        int Nx = static_cast<int>(x_weights.size()), Ny = static_cast<int>(y_weights.size());
+        grid_for(comm, Nx, Ny, Px, Py, periodic_x, periodic_y);
+        return Decomp2D(comm, balanced_splits({x_weights}, Px), balanced_splits({y_weights}, Py), nghost,
+                        periodic_x, periodic_y);
+    }
+
+    // Load-balanced decomposition for a cost per cell (cell_weights[i * Ny + j], the same on
+    // every rank). The blocks stay a tensor product of x- and y-splits (so every rank keeps four
+    // face neighbours); the splits of one axis are rebalanced against the other in turn,
+    // starting from the row and column sums, to reduce the weight of the heaviest block.
+    static Decomp2D weighted(MPI_Comm comm, int Nx, int Ny, const std::vector<double> &cell_weights,
+                             int Px = 0, int Py = 0, int nghost = 0, bool periodic_x = false, bool periodic_y = false)
+    {
+        if (static_cast<long long>(cell_weights.size()) != static_cast<long long>(Nx) * Ny) {
+            std::cerr << "Error: expected " << static_cast<long long>(Nx) * Ny << " cell weights but got "
+                      << cell_weights.size() << std::endl;
+            MPI_Abort(comm, 1);
+        }
+        grid_for(comm, Nx, Ny, Px, Py, periodic_x, periodic_y);
+
+        auto w = [&](int i, int j) { return cell_weights[static_cast<std::size_t>(i) * Ny + j]; };
+        std::vector<double> col(Nx, 0.0), row(Ny, 0.0);
+        for (int i = 0; i < Nx; ++i) {
+            for (int j = 0; j < Ny; ++j) {
+                col[i] += w(i, j);
+                row[j] += w(i, j);
+            }
+        }
+        std::vector<int> xs = balanced_splits({col}, Px), ys = balanced_splits({row}, Py);
+        double best = max_block_weight(cell_weights, Ny, xs, ys);
+
+        for (int sweep = 0; sweep < 8; ++sweep) {
+            // y-splits against the columns of the current x-splits, then the other way round
+            std::vector<std::vector<double>> y_chains(Px, std::vector<double>(Ny, 0.0));
+            for (int p = 0; p < Px; ++p) {
+                for (int i = xs[p]; i < xs[p + 1]; ++i) {
+                    for (int j = 0; j < Ny; ++j) y_chains[p][j] += w(i, j);
+                }
+            }
+            std::vector<int> ys_new = balanced_splits(y_chains, Py);
+
+            std::vector<std::vector<double>> x_chains(Py, std::vector<double>(Nx, 0.0));
+            for (int i = 0; i < Nx; ++i) {
+                for (int q = 0; q < Py; ++q) {
+                    for (int j = ys_new[q]; j < ys_new[q + 1]; ++j) x_chains[q][i] += w(i, j);
+                }
+            }
+            std::vector<int> xs_new = balanced_splits(x_chains, Px);
+
+            double weight = max_block_weight(cell_weights, Ny, xs_new, ys_new);
+            if (weight >= best) break;
+            best = weight;
+            xs = xs_new;
+            ys = ys_new;
+        }
+        return Decomp2D(comm, xs, ys, nghost, periodic_x, periodic_y);
+    }
+
+    // Splits of n points (the length of every chain) into p parts, p <= n, that minimise the
+    // largest part weight over all chains (weight of part [a, b) in chain c: sum of chains[c][a..b)).
+    // Every part gets at least one point.
+    static std::vector<int> balanced_splits(const std::vector<std::vector<double>> &chains, int p)
+    {
+        int n = static_cast<int>(chains.front().size());
+        double lo = 0.0, hi = 0.0;
+        for (const std::vector<double> &c : chains) {
+            double total = 0.0;
+            for (double v : c) {
+                lo = std::max(lo, v);
+                total += v;
+            }
+            hi = std::max(hi, total);
+        }
+
+        // bisection on the bottleneck weight, the greedy cut is feasible for every bound >= optimum
+        std::vector<int> splits = greedy_splits(chains, hi);
+        for (int it = 0; it < 60 && hi - lo > 1e-12 * hi; ++it) {
+            double mid = 0.5 * (lo + hi);
+            std::vector<int> trial = greedy_splits(chains, mid);
+            if (static_cast<int>(trial.size()) - 1 <= p) {
+                hi = mid;
+                splits = trial;
+            }
+            else {
+                lo = mid;
+            }
+        }
 
-        // Compute local grid size (handle cases where Nx or Ny is not divisible by Px or Py)
-        int base_x = Nx_ / Px_;
-        int base_y = Ny_ / Py_;
-        int rem_x = Nx_ % Px_;
-        int rem_y = Ny_ % Py_;
+        // fewer parts than ranks: halve the part with the most points until there are p
+        while (static_cast<int>(splits.size()) - 1 < p) {
+            int widest = 0;
+            for (int k = 1; k + 1 < static_cast<int>(splits.size()); ++k) {
+                if (splits[k + 1] - splits[k] > splits[widest + 1] - splits[widest]) widest = k;
+            }
+            if (splits[widest + 1] - splits[widest] < 2) break; // fewer points than ranks
+            splits.insert(splits.begin() + widest + 1, (splits[widest] + splits[widest + 1]) / 2);
+        }
+        while (static_cast<int>(splits.size()) - 1 < p) splits.push_back(n);
+        return splits;
+    }
 
-        if (px_ <rem_x) {
-            nx_ = base_x + 1; // add one more column to the first (Nx % Px) processes in x direction
-            i0_ = px_ * (base_x + 1);
+    // Weight of the heaviest block of a tensor decomposition of per-cell weights
+    static double max_block_weight(const std::vector<double> &cell_weights, int Ny,
+                                   const std::vector<int> &x_splits, const std::vector<int> &y_splits)
+    {
+        double heaviest = 0.0;
+        for (std::size_t p = 0; p + 1 < x_splits.size(); ++p) {
+            for (std::size_t q = 0; q + 1 < y_splits.size(); ++q) {
+                double sum = 0.0;
+                for (int i = x_splits[p]; i < x_splits[p + 1]; ++i) {
+                    for (int j = y_splits[q]; j < y_splits[q + 1]; ++j) sum += cell_weights[static_cast<std::size_t>(i) * Ny + j];
+                }
+                heaviest = std::max(heaviest, sum);
+            }
         }
-        else {
-            nx_ = base_x;
-            i0_ = (rem_x * (base_x + 1)) + (px_ - rem_x) * base_x;
+        return heaviest;
+    }
+
+private:
+    static void grid_for(MPI_Comm comm, int Nx, int Ny, int &Px, int &Py, bool periodic_x, bool periodic_y)
+    {
+        if (Px > 0 && Py > 0) return;
+        int size;
+        MPI_Comm_size(comm, &size);
+        choose_grid(size, Nx, Ny, Px, Py, periodic_x, periodic_y);
+    }
+
+    // Cut the chains left to right as late as possible while no part exceeds bound in any chain
+    static std::vector<int> greedy_splits(const std::vector<std::vector<double>> &chains, double bound)
+    {
+        int n = static_cast<int>(chains.front().size());
+        std::vector<double> sums(chains.size(), 0.0);
+        std::vector<int> splits{0};
+        for (int j = 0; j < n; ++j) {
+            bool fits = true;
+            for (std::size_t c = 0; c < chains.size(); ++c) fits = fits && sums[c] + chains[c][j] <= bound;
+            if (!fits && j > splits.back()) {
+                splits.push_back(j);
+                std::fill(sums.begin(), sums.end(), 0.0);
+            }
+            for (std::size_t c = 0; c < chains.size(); ++c) sums[c] += chains[c][j];
         }
-        i1_ = i0_ + nx_;
+        splits.push_back(n);
+        return splits;
+    }
 
-        if (py_ < rem_y) {
-            ny_ = base_y + 1; // add one more row to the first (Ny % Py) processes in y direction
-            j0_ = py_ * (base_y + 1);
+    // Most neighbours of one rank along an axis of p ranks
+    static long long neighbours(int p, bool periodic) {
+        if (p == 1) return 0;
+        return (periodic || p > 2) ? 2 : 1;
+    }
+
+    // Number of rank interfaces along an axis of p ranks
+    static long long interfaces(int p, bool periodic) {
+        return (periodic && p > 1) ? p : p - 1;
+    }
+
+    // Split n points into p nearly equal parts, the first n % p parts get one point more
+    static std::vector<int> uniform_splits(int n, int p) {
+        std::vector<int> splits(p + 1);
+        int base = n / p;
+        int rem = n % p;
+        for (int k = 0; k <= p; ++k) {
+            splits[k] = k * base + std::min(k, rem);
         }
-        else {
-            ny_ = base_y;
-            j0_ = (rem_y * (base_y + 1)) + (py_ - rem_y) * base_y;
+        return splits;
+    }
+
+    static bool valid_splits(const std::vector<int> &splits) {
+        if (splits.size() < 2 || splits.front() != 0 || splits.back() <= 0) return false;
+        for (std::size_t k = 1; k < splits.size(); ++k) {
+            if (splits[k] < splits[k - 1]) return false;
         }
-        j1_ = j0_ + ny_;
+        return true;
+    }
+
+    // Cartesian communicator, local bounds and neighbours of this rank from the splits
+    void init()
+    {
+        // A communicator that is already Cartesian (e.g. of a finer grid whose splits were halved)
+        // keeps its rank order, so the same rank owns the same part of the domain on both grids
+        int topology = MPI_UNDEFINED;
+        MPI_Topo_test(comm_, &topology);
+        int reorder = (topology == MPI_CART) ? 0 : 1;
+        int dims[2] = {Py_, Px_};
+        int periods[2] = {periodic_y_, periodic_x_};
+        MPI_Comm cart;
+        MPI_Cart_create(comm_, 2, dims, periods, reorder, &cart);
+        cart_ = std::shared_ptr<MPI_Comm>(new MPI_Comm(cart), CommFree());
+        comm_ = cart;
+        MPI_Comm_rank(comm_, &rank_);
+
+        // Determine the process grid coordinates
+        int coords[2];
+        MPI_Cart_coords(comm_, rank_, 2, coords);
+        py_ = coords[0];
+        px_ = coords[1];
+
+        i0_ = x_splits_[px_];
+        i1_ = x_splits_[px_ + 1];
+        nx_ = i1_ - i0_;
+
+        j0_ = y_splits_[py_];
+        j1_ = y_splits_[py_ + 1];
+        ny_ = j1_ - j0_;
 
         // Check domain bounds
         if (i1_ < i0_ || i0_ < 0 || i1_ > Nx_ || j1_ < j0_ || j0_ < 0 || j1_ > Ny_)
@@ -78,15 +359,9 @@ public:
 
 
         // Determine neighbors (up, down, left, right)
-        // Non-periodic boundaries: if there is no neighbor, set to MPI_PROC_NULL, add later support for periodic boundaries
-        if (px_ > 0) left_ = rank_ - 1; // left
-        else left_ = MPI_PROC_NULL; // no left neighbor
-        if (px_ < Px_ - 1) right_ = rank_ + 1; // right
-        else right_ = MPI_PROC_NULL; // no right neighbor
-        if (py_ > 0) down_ = rank_ - Px_; // down
-        else down_ = MPI_PROC_NULL; // no down neighbor
-        if (py_ < Py_ - 1) up_ = rank_ + Px_; // up
-        else up_ = MPI_PROC_NULL; // no up neighbor
+        // Along a non-periodic axis the edge ranks get MPI_PROC_NULL as the missing neighbor
+        MPI_Cart_shift(comm_, 1, 1, &left_, &right_);
+        MPI_Cart_shift(comm_, 0, 1, &down_, &up_);
 
         // Check nghost is non-negative
         if (nghost_ < 0) {
@@ -98,6 +373,7 @@ public:
 
     }
 
+public:
     // Getters for local grid bounds
     int i0() const { return i0_; }
     int i1() const { return i1_; }
@@ -122,12 +398,20 @@ public:
     int nx() const { return nx_; }
     int ny() const { return ny_; }
 
+    // Getters for the periodicity of the axes
+    bool periodic_x() const { return periodic_x_; }
+    bool periodic_y() const { return periodic_y_; }
+
+    // Getters for the splits of all ranks (Px + 1 and Py + 1 entries)
+    const std::vector<int> &x_splits() const { return x_splits_; }
+    const std::vector<int> &y_splits() const { return y_splits_; }
+
     // Getter for rank and size    
     int size() const { return size_; } 
     int rank() const { return rank_; }
     int nghost() const { return nghost_; }
 
-    // Getter got comm
+    // Getter got comm (the Cartesian communicator, valid as long as a copy of this Decomp2D exists)
     MPI_Comm comm() const { return comm_; }
 
 };
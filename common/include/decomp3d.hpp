@@ -0,0 +1,203 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+// Which axes of a 3D grid are split over ranks:
+//  Slab   - x only (Py = Pz = 1)
+//  Pencil - x and y, every rank owns full z-columns (Pz = 1)
+//  Block  - all three axes
+enum class Layout3D { Block, Pencil, Slab };
+
+// Block decomposition of an Nx x Ny x Nz grid over a Px x Py x Pz process grid, the 3D
+// counterpart of Decomp2D: a shared Cartesian communicator (dims {Pz, Py, Px}, so px varies
+// fastest, reorder enabled), remainders handed to the first ranks, optional periodic axes.
+// Face neighbours: left/right (x), down/up (y), back/front (z); neighbor(dx, dy, dz) gives any
+// of the 26 neighbours.
+class Decomp3D
+{
+    // Frees the Cartesian communicator, unless MPI is already finalized
+    struct CommFree {
+        void operator()(MPI_Comm *comm) const {
+            int finalized = 0;
+            MPI_Finalized(&finalized);
+            if (!finalized && *comm != MPI_COMM_NULL) MPI_Comm_free(comm);
+            delete comm;
+        }
+    };
+
+    MPI_Comm comm_; // the Cartesian communicator once constructed
+    std::shared_ptr<MPI_Comm> cart_;
+    int N_[3]; // global grid size
+    int P_[3]; // process grid size
+    int rank_, size_;
+    int p_[3]; // process coordinates in the process grid
+    int lo_[3], hi_[3]; // bounds are half open: [lo, hi)
+    int minus_[3], plus_[3]; // face neighbours along each axis
+    int nghost_; // number of ghost cells for communication
+    bool periodic_[3];
+
+public:
+    Decomp3D(MPI_Comm comm, int Nx, int Ny, int Nz, int Px, int Py, int Pz, int nghost = 0,
+             bool periodic_x = false, bool periodic_y = false, bool periodic_z = false)
+        : comm_(comm), N_{Nx, Ny, Nz}, P_{Px, Py, Pz}, nghost_(nghost), periodic_{periodic_x, periodic_y, periodic_z}
+    {
+        MPI_Comm_rank(comm_, &rank_);
+        MPI_Comm_size(comm_, &size_);
+
+        // check that the number of processes matches the decomposition
+        if (size_ != Px * Py * Pz)
+        {
+            if (rank_ == 0) {
+                std::cerr << "Error: Number of processes must be equal to Px * Py * Pz" << std::endl;
+            }
+            MPI_Abort(comm_, 1);
+        }
+
+        // check if the sizes are greater than 0 and nghost is non-negative
+        if (Nx <= 0 || Ny <= 0 || Nz <= 0 || Px <= 0 || Py <= 0 || Pz <= 0 || nghost < 0)
+        {
+            if (rank_ == 0) {
+                std::cerr << "Error: Nx, Ny, Nz, Px, Py, Pz must be greater than 0 and nghost non-negative" << std::endl;
+            }
+            MPI_Abort(comm_, 1);
+        }
+
+        int topology = MPI_UNDEFINED;
+        MPI_Topo_test(comm_, &topology);
+        int reorder = (topology == MPI_CART) ? 0 : 1;
+        int dims[3] = {Pz, Py, Px};
+        int periods[3] = {periodic_z, periodic_y, periodic_x};
+        MPI_Comm cart;
+        MPI_Cart_create(comm_, 3, dims, periods, reorder, &cart);
+        cart_ = std::shared_ptr<MPI_Comm>(new MPI_Comm(cart), CommFree());
+        comm_ = cart;
+        MPI_Comm_rank(comm_, &rank_);
+
+        int coords[3];
+        MPI_Cart_coords(comm_, rank_, 3, coords);
+        for (int a = 0; a < 3; ++a) {
+            p_[a] = coords[2 - a];
+            // the first N % P ranks along the axis get one point more
+            int base = N_[a] / P_[a], rem = N_[a] % P_[a];
+            lo_[a] = p_[a] * base + std::min(p_[a], rem);
+            hi_[a] = lo_[a] + base + (p_[a] < rem ? 1 : 0);
+            MPI_Cart_shift(comm_, 2 - a, 1, &minus_[a], &plus_[a]);
+        }
+    }
+
+    // Decomposition over all ranks of comm with the process grid chosen by choose_grid
+    static Decomp3D create(MPI_Comm comm, int Nx, int Ny, int Nz, int nghost = 0, Layout3D layout = Layout3D::Block,
+                           bool periodic_x = false, bool periodic_y = false, bool periodic_z = false)
+    {
+        int size;
+        MPI_Comm_size(comm, &size);
+        int Px, Py, Pz;
+        choose_grid(size, Nx, Ny, Nz, layout, Px, Py, Pz, periodic_x, periodic_y, periodic_z);
+        return Decomp3D(comm, Nx, Ny, Nz, Px, Py, Pz, nghost, periodic_x, periodic_y, periodic_z);
+    }
+
+    // Process grid of the given layout with Px * Py * Pz = size that minimises the halo volume
+    // of the busiest rank (largest block, most neighbours); ties go to the smaller total volume,
+    // then to splitting x before y before z (faces normal to x are contiguous in memory)
+    static void choose_grid(int size, int Nx, int Ny, int Nz, Layout3D layout, int &Px, int &Py, int &Pz,
+                            bool periodic_x = false, bool periodic_y = false, bool periodic_z = false)
+    {
+        const long long N[3] = {Nx, Ny, Nz};
+        const bool periodic[3] = {periodic_x, periodic_y, periodic_z};
+        long long best_busy = -1, best_total = -1;
+        Px = size;
+        Py = Pz = 1;
+        for (int px = size; px >= 1; --px) {
+            if (size % px != 0) continue;
+            for (int py = size / px; py >= 1; --py) {
+                if ((size / px) % py != 0) continue;
+                int pz = size / px / py;
+                if (layout == Layout3D::Slab && (py > 1 || pz > 1)) continue;
+                if (layout == Layout3D::Pencil && pz > 1) continue;
+                if (px > Nx || py > Ny || pz > Nz) continue;
+                const long long P[3] = {px, py, pz};
+                long long n[3], busy = 0, total = 0;
+                for (int a = 0; a < 3; ++a) n[a] = (N[a] + P[a] - 1) / P[a];
+                for (int a = 0; a < 3; ++a) {
+                    long long face = n[(a + 1) % 3] * n[(a + 2) % 3];
+                    long long neighbours = (P[a] == 1) ? 0 : ((periodic[a] || P[a] > 2) ? 2 : 1);
+                    long long interfaces = (periodic[a] && P[a] > 1) ? P[a] : P[a] - 1;
+                    busy += neighbours * face;
+                    total += interfaces * N[(a + 1) % 3] * N[(a + 2) % 3];
+                }
+                if (best_busy < 0 || busy < best_busy || (busy == best_busy && total < best_total)) {
+                    best_busy = busy;
+                    best_total = total;
+                    Px = px;
+                    Py = py;
+                    Pz = pz;
+                }
+            }
+        }
+    }
+
+    // Rank of the neighbour at offset (dx, dy, dz), each in {-1, 0, 1}; MPI_PROC_NULL if it
+    // falls outside a non-periodic axis
+    int neighbor(int dx, int dy, int dz) const {
+        const int d[3] = {dx, dy, dz};
+        int coords[3];
+        for (int a = 0; a < 3; ++a) {
+            int c = p_[a] + d[a];
+            if (c < 0 || c >= P_[a]) {
+                if (!periodic_[a]) return MPI_PROC_NULL;
+                c = (c + P_[a]) % P_[a];
+            }
+            coords[2 - a] = c;
+        }
+        int r;
+        MPI_Cart_rank(comm_, coords, &r);
+        return r;
+    }
+
+    // Getters for local grid bounds
+    int i0() const { return lo_[0]; }
+    int i1() const { return hi_[0]; }
+    int j0() const { return lo_[1]; }
+    int j1() const { return hi_[1]; }
+    int k0() const { return lo_[2]; }
+    int k1() const { return hi_[2]; }
+
+    // Getters for the face neighbors
+    int left() const { return minus_[0]; }
+    int right() const { return plus_[0]; }
+    int down() const { return minus_[1]; }
+    int up() const { return plus_[1]; }
+    int back() const { return minus_[2]; }
+    int front() const { return plus_[2]; }
+
+    // Getter for the process coordinates and grid
+    int px() const { return p_[0]; }
+    int py() const { return p_[1]; }
+    int pz() const { return p_[2]; }
+    int Px() const { return P_[0]; }
+    int Py() const { return P_[1]; }
+    int Pz() const { return P_[2]; }
+
+    // Getter for local and global grid sizes
+    int Nx() const { return N_[0]; }
+    int Ny() const { return N_[1]; }
+    int Nz() const { return N_[2]; }
+    int nx() const { return hi_[0] - lo_[0]; }
+    int ny() const { return hi_[1] - lo_[1]; }
+    int nz() const { return hi_[2] - lo_[2]; }
+
+    bool periodic_x() const { return periodic_[0]; }
+    bool periodic_y() const { return periodic_[1]; }
+    bool periodic_z() const { return periodic_[2]; }
+
+    int size() const { return size_; }
+    int rank() const { return rank_; }
+    int nghost() const { return nghost_; }
+
+    // The Cartesian communicator, valid as long as a copy of this Decomp3D exists
+    MPI_Comm comm() const { return comm_; }
+};
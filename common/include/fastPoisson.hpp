@@ -0,0 +1,288 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "decomp2d.hpp"
+#include "fft.hpp"
+#include "field2d.hpp"
+#include "fieldOps.hpp"
+#include "parallel.hpp"
+#include "poisson2d.hpp"
+#include "profiler.hpp"
+#include "solver.hpp"
+
+
+// Fast direct solver for A x = b with A = Poisson2D on a grid with Dirichlet boundaries on
+// both axes. The sine vectors sin(pi k i / (Nx - 1)) sin(pi l j / (Ny - 1)) are the
+// eigenvectors of A, with the eigenvalues
+//   lambda_kl = 4 / hx^2 sin^2(pi k / (2 (Nx - 1))) + 4 / hy^2 sin^2(pi l / (2 (Ny - 1)))
+// so x = S^{-1} Lambda^{-1} S b with the 2D sine transform S (fft::DST1 along y, then along x):
+// O(N log N) work and no iterations.
+//
+// The transforms need whole lines, so the blocks of the Decomp2D are transposed into pencils
+// with MPI_Alltoallv, along one axis of the process grid at a time: within a column of ranks
+// (same px) a block of nx x ny cells becomes a y-pencil of nx / Py full rows of Ny cells, within
+// a row of ranks (same py) an x-pencil of ny / Px full columns of Nx cells. A solve is
+//   block -> y-pencil, DST in y -> block -> x-pencil, DST in x, divide, DST in x -> block
+//   -> y-pencil, DST in y -> block
+// i.e. six all-to-alls among Py or Px ranks, all computed in double whatever T is.
+//
+// Usable as a solver (solve, which reports the residual of the result) and as an exact
+// preconditioner (apply; CG then converges in one iteration).
+template <typename T>
+class FastPoisson : public Preconditioner<T>
+{
+    Poisson2D<T> &A_;
+    Field2D<T> r_;
+    MPI_Comm col_comm_ = MPI_COMM_NULL; // ranks with the same px, ordered by py
+    MPI_Comm row_comm_ = MPI_COMM_NULL; // ranks with the same py, ordered by px
+    int Nx_, Ny_, nx_, ny_;
+    std::vector<int> rows_; // local x-layers of the y-pencil of each rank of the column (Py + 1 offsets)
+    std::vector<int> cols_; // local y-layers of the x-pencil of each rank of the row (Px + 1 offsets)
+    int num_rows_, num_cols_; // lines of the own y- and x-pencil
+    int col0_; // first local y-layer of the own x-pencil
+    std::vector<int> y_block_counts_, y_block_displs_, y_pencil_counts_, y_pencil_displs_;
+    std::vector<int> x_block_counts_, x_block_displs_, x_pencil_counts_, x_pencil_displs_;
+    fft::DST1 dst_x_, dst_y_;
+    std::vector<double> eig_x_, eig_y_; // eigenvalues of the 1D operators, by mode (= grid index)
+    std::vector<double> block_, y_pencil_, x_pencil_, send_, recv_;
+
+public:
+    double rtol = 1e-8; // solve() reports convergence when ||b - A x|| <= rtol * ||b||
+
+    explicit FastPoisson(Poisson2D<T> &A)
+        : A_(A), r_(A.decomp()), Nx_(A.decomp().Nx()), Ny_(A.decomp().Ny()), nx_(A.decomp().nx()),
+          ny_(A.decomp().ny()), dst_x_(std::max(Nx_ - 2, 0)), dst_y_(std::max(Ny_ - 2, 0))
+    {
+        const Decomp2D &decomp = A.decomp();
+        if (decomp.periodic_x() || decomp.periodic_y()) {
+            if (decomp.rank() == 0) {
+                std::cerr << "Error: FastPoisson needs Dirichlet boundaries on both axes" << std::endl;
+            }
+            MPI_Abort(decomp.comm(), 1);
+        }
+        // coordinate 0 of the Cartesian communicator is py, coordinate 1 is px
+        int keep_py[2] = {1, 0}, keep_px[2] = {0, 1};
+        MPI_Cart_sub(decomp.comm(), keep_py, &col_comm_);
+        MPI_Cart_sub(decomp.comm(), keep_px, &row_comm_);
+
+        const int Px = decomp.Px(), Py = decomp.Py();
+        const std::vector<int> &xs = decomp.x_splits(), &ys = decomp.y_splits();
+        rows_ = split(nx_, Py);
+        cols_ = split(ny_, Px);
+        col0_ = cols_[decomp.px()];
+        num_rows_ = rows_[decomp.py() + 1] - rows_[decomp.py()];
+        num_cols_ = cols_[decomp.px() + 1] - col0_;
+
+        // y: the block sends its x-layers [rows[q], rows[q+1]) to rank q of the column, which
+        // receives them as num_rows x ny_q pieces
+        y_block_counts_.resize(Py);
+        y_block_displs_.resize(Py);
+        y_pencil_counts_.resize(Py);
+        y_pencil_displs_.resize(Py);
+        for (int q = 0; q < Py; ++q) {
+            y_block_counts_[q] = (rows_[q + 1] - rows_[q]) * ny_;
+            y_block_displs_[q] = rows_[q] * ny_;
+            y_pencil_counts_[q] = num_rows_ * (ys[q + 1] - ys[q]);
+            y_pencil_displs_[q] = num_rows_ * ys[q];
+        }
+        // x: the transposed block (ny x nx) sends its y-layers [cols[p], cols[p+1]) to rank p of
+        // the row, which receives them as num_cols x nx_p pieces
+        x_block_counts_.resize(Px);
+        x_block_displs_.resize(Px);
+        x_pencil_counts_.resize(Px);
+        x_pencil_displs_.resize(Px);
+        for (int p = 0; p < Px; ++p) {
+            x_block_counts_[p] = (cols_[p + 1] - cols_[p]) * nx_;
+            x_block_displs_[p] = cols_[p] * nx_;
+            x_pencil_counts_[p] = num_cols_ * (xs[p + 1] - xs[p]);
+            x_pencil_displs_[p] = num_cols_ * xs[p];
+        }
+
+        const double pi = std::acos(-1.0);
+        const double inv_hx2 = A.inv_hx2(), inv_hy2 = A.inv_hy2();
+        eig_x_.assign(Nx_, 0.0);
+        eig_y_.assign(Ny_, 0.0);
+        for (int k = 1; k + 1 < Nx_; ++k) eig_x_[k] = 4.0 * inv_hx2 * std::pow(std::sin(pi * k / (2.0 * (Nx_ - 1))), 2);
+        for (int l = 1; l + 1 < Ny_; ++l) eig_y_[l] = 4.0 * inv_hy2 * std::pow(std::sin(pi * l / (2.0 * (Ny_ - 1))), 2);
+
+        const std::size_t block = static_cast<std::size_t>(nx_) * ny_;
+        const std::size_t y_pencil = static_cast<std::size_t>(num_rows_) * Ny_;
+        const std::size_t x_pencil = static_cast<std::size_t>(num_cols_) * Nx_;
+        block_.resize(block);
+        y_pencil_.resize(y_pencil);
+        x_pencil_.resize(x_pencil);
+        send_.resize(std::max({block, y_pencil, x_pencil}));
+        recv_.resize(send_.size());
+    }
+
+    ~FastPoisson() override {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (finalized) return;
+        if (col_comm_ != MPI_COMM_NULL) MPI_Comm_free(&col_comm_);
+        if (row_comm_ != MPI_COMM_NULL) MPI_Comm_free(&row_comm_);
+    }
+
+    FastPoisson(const FastPoisson&) = delete;
+    FastPoisson& operator=(const FastPoisson&) = delete;
+
+    // Solve A x = b directly (the initial x is ignored); iterations is 1, residual the true one
+    SolveStats solve(const Field2D<T> &b, Field2D<T> &x) {
+        const Box &box = A_.box();
+        MPI_Comm comm = A_.comm();
+        SolveStats stats;
+        stats.iterations = 1;
+        double norm_b = fieldops::norm2(b, box, comm);
+        if (norm_b == 0.0) {
+            fieldops::set(x, T(0), box);
+            stats.converged = true;
+            return stats;
+        }
+        apply(b, x);
+        A_.residual(x, b, r_);
+        stats.residual = fieldops::norm2(r_, box, comm) / norm_b;
+        stats.converged = stats.residual <= rtol;
+        return stats;
+    }
+
+    // z = A^{-1} r on the unknowns
+    void apply(const Field2D<T> &r, Field2D<T> &z) override {
+        PDE_PROFILE_SCOPE("fastpoisson.solve");
+        const Box &box = A_.box();
+        // the boundary cells of the block stay zero, the transforms only touch the unknowns
+        std::fill(block_.begin(), block_.end(), 0.0);
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            const T *pr = r.row(i);
+            for (int j = box.j_begin; j < box.j_end; ++j) block_[static_cast<std::size_t>(i) * ny_ + j] = pr[j];
+        }
+
+        to_y_pencil();
+        transform_y();
+        from_y_pencil();
+
+        to_x_pencil();
+        {
+            PDE_PROFILE_SCOPE("fastpoisson.dst");
+            dst_x_.apply(x_pencil_.data() + 1, num_cols_, Nx_);
+        }
+        divide();
+        {
+            PDE_PROFILE_SCOPE("fastpoisson.dst");
+            dst_x_.apply(x_pencil_.data() + 1, num_cols_, Nx_);
+        }
+        from_x_pencil();
+
+        to_y_pencil();
+        transform_y();
+        from_y_pencil();
+
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            T *pz = z.row(i);
+            for (int j = box.j_begin; j < box.j_end; ++j) pz[j] = static_cast<T>(block_[static_cast<std::size_t>(i) * ny_ + j]);
+        }
+    }
+
+private:
+    // n points in p nearly equal parts, the first n % p parts get one point more (p + 1 offsets)
+    static std::vector<int> split(int n, int p) {
+        std::vector<int> offsets(p + 1);
+        for (int k = 0; k <= p; ++k) offsets[k] = k * (n / p) + std::min(k, n % p);
+        return offsets;
+    }
+
+    void transform_y() {
+        PDE_PROFILE_SCOPE("fastpoisson.dst");
+        dst_y_.apply(y_pencil_.data() + 1, num_rows_, Ny_);
+    }
+
+    // Divide the modes (k, l) of the x-pencil by lambda_kl and the scale of the two inverse
+    // transforms, 2 (Nx - 1) 2 (Ny - 1); the boundary positions hold no mode and are zeroed
+    void divide() {
+        const double scale = 1.0 / (4.0 * (Nx_ - 1.0) * (Ny_ - 1.0));
+        const int j_first = A_.decomp().j0() + col0_;
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(num_cols_) * Nx_ >= parallel::min_parallel))
+        for (int c = 0; c < num_cols_; ++c) {
+            double *line = x_pencil_.data() + static_cast<std::size_t>(c) * Nx_;
+            const int l = j_first + c;
+            if (l == 0 || l == Ny_ - 1) {
+                std::fill(line, line + Nx_, 0.0);
+                continue;
+            }
+            line[0] = line[Nx_ - 1] = 0.0;
+            for (int k = 1; k + 1 < Nx_; ++k) line[k] *= scale / (eig_x_[k] + eig_y_[l]);
+        }
+    }
+
+    // block_ -> y_pencil_ within the column of ranks
+    void to_y_pencil() {
+        PDE_PROFILE_SCOPE("fastpoisson.transpose");
+        MPI_Alltoallv(block_.data(), y_block_counts_.data(), y_block_displs_.data(), MPI_DOUBLE, recv_.data(),
+                      y_pencil_counts_.data(), y_pencil_displs_.data(), MPI_DOUBLE, col_comm_);
+        const std::vector<int> &ys = A_.decomp().y_splits();
+        for (int q = 0; q + 1 < static_cast<int>(ys.size()); ++q) {
+            const int width = ys[q + 1] - ys[q];
+            const double *piece = recv_.data() + y_pencil_displs_[q];
+            for (int i = 0; i < num_rows_; ++i) {
+                std::copy(piece + i * width, piece + (i + 1) * width, y_pencil_.data() + static_cast<std::size_t>(i) * Ny_ + ys[q]);
+            }
+        }
+    }
+
+    // y_pencil_ -> block_ within the column of ranks
+    void from_y_pencil() {
+        PDE_PROFILE_SCOPE("fastpoisson.transpose");
+        const std::vector<int> &ys = A_.decomp().y_splits();
+        for (int q = 0; q + 1 < static_cast<int>(ys.size()); ++q) {
+            const int width = ys[q + 1] - ys[q];
+            double *piece = send_.data() + y_pencil_displs_[q];
+            for (int i = 0; i < num_rows_; ++i) {
+                const double *line = y_pencil_.data() + static_cast<std::size_t>(i) * Ny_ + ys[q];
+                std::copy(line, line + width, piece + i * width);
+            }
+        }
+        MPI_Alltoallv(send_.data(), y_pencil_counts_.data(), y_pencil_displs_.data(), MPI_DOUBLE, block_.data(),
+                      y_block_counts_.data(), y_block_displs_.data(), MPI_DOUBLE, col_comm_);
+    }
+
+    // block_ -> x_pencil_ within the row of ranks
+    void to_x_pencil() {
+        PDE_PROFILE_SCOPE("fastpoisson.transpose");
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(nx_) * ny_ >= parallel::min_parallel))
+        for (int j = 0; j < ny_; ++j) {
+            for (int i = 0; i < nx_; ++i) send_[static_cast<std::size_t>(j) * nx_ + i] = block_[static_cast<std::size_t>(i) * ny_ + j];
+        }
+        MPI_Alltoallv(send_.data(), x_block_counts_.data(), x_block_displs_.data(), MPI_DOUBLE, recv_.data(),
+                      x_pencil_counts_.data(), x_pencil_displs_.data(), MPI_DOUBLE, row_comm_);
+        const std::vector<int> &xs = A_.decomp().x_splits();
+        for (int p = 0; p + 1 < static_cast<int>(xs.size()); ++p) {
+            const int width = xs[p + 1] - xs[p];
+            const double *piece = recv_.data() + x_pencil_displs_[p];
+            for (int c = 0; c < num_cols_; ++c) {
+                std::copy(piece + c * width, piece + (c + 1) * width, x_pencil_.data() + static_cast<std::size_t>(c) * Nx_ + xs[p]);
+            }
+        }
+    }
+
+    // x_pencil_ -> block_ within the row of ranks
+    void from_x_pencil() {
+        PDE_PROFILE_SCOPE("fastpoisson.transpose");
+        const std::vector<int> &xs = A_.decomp().x_splits();
+        for (int p = 0; p + 1 < static_cast<int>(xs.size()); ++p) {
+            const int width = xs[p + 1] - xs[p];
+            double *piece = send_.data() + x_pencil_displs_[p];
+            for (int c = 0; c < num_cols_; ++c) {
+                const double *line = x_pencil_.data() + static_cast<std::size_t>(c) * Nx_ + xs[p];
+                std::copy(line, line + width, piece + c * width);
+            }
+        }
+        MPI_Alltoallv(send_.data(), x_pencil_counts_.data(), x_pencil_displs_.data(), MPI_DOUBLE, recv_.data(),
+                      x_block_counts_.data(), x_block_displs_.data(), MPI_DOUBLE, row_comm_);
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(nx_) * ny_ >= parallel::min_parallel))
+        for (int i = 0; i < nx_; ++i) {
+            for (int j = 0; j < ny_; ++j) block_[static_cast<std::size_t>(i) * ny_ + j] = recv_[static_cast<std::size_t>(j) * nx_ + i];
+        }
+    }
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <memory>
+
+
+// Real-to-real sine transforms for the fast Poisson solver (fastPoisson.hpp).
+//
+// DST1 is the type-I discrete sine transform of length m, in the convention of FFTW's
+// RODFT00:
+//   y_k = 2 sum_{j=0}^{m-1} x_j sin(pi (j + 1) (k + 1) / (m + 1)),   k = 0 .. m-1
+// It is its own inverse up to a factor: applying it twice multiplies by 2 (m + 1). Its
+// eigenvectors diagonalise the 1D Dirichlet Laplacian, which is what the fast solver uses.
+//
+// With FFTW (ENABLE_FFTW, PDE_HAVE_FFTW) the transform is FFTW's RODFT00. Otherwise an
+// in-tree FFT does it: two real lines at a time go through one complex FFT of length
+// 2 (m + 1) of their odd extensions, radix-2 for powers of two and Bluestein's chirp-z
+// algorithm (a power-of-two convolution) for other lengths.
+namespace fft
+{
+
+class DST1
+{
+public:
+    explicit DST1(int m);
+    ~DST1();
+    DST1(const DST1&) = delete;
+    DST1& operator=(const DST1&) = delete;
+
+    int size() const { return m_; }
+
+    // Transform count lines in place; line l holds m contiguous values starting at data + l * stride.
+    // Lines are split over the OpenMP threads.
+    void apply(double *data, int count, long long stride) const;
+
+private:
+    struct Impl;
+    int m_;
+    std::unique_ptr<Impl> impl_;
+};
+
+// Name of the backend in use ("FFTW" or "in-tree FFT")
+const char *backend();
+
+} // namespace fft
@@ -0,0 +1,167 @@
+#pragma once
+#include <mpi.h>
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include "decomp2d.hpp"
+#include "parallel.hpp"
+
+
+// Half-open box of local indices [i_begin, i_end) x [j_begin, j_end).
+// Local indices are relative to the first owned cell of a Field2D, so ghost cells have
+// negative indices or indices >= nx (ny).
+struct Box
+{
+    int i_begin, i_end, j_begin, j_end;
+
+    bool empty() const { return i_end <= i_begin || j_end <= j_begin; }
+    long long count() const { return empty() ? 0 : static_cast<long long>(i_end - i_begin) * (j_end - j_begin); }
+
+    // Box grown by g cells on every side (shrunk for negative g)
+    Box grow(int g) const { return {i_begin - g, i_end + g, j_begin - g, j_end + g}; }
+
+    Box intersect(const Box &o) const {
+        return {std::max(i_begin, o.i_begin), std::min(i_end, o.i_end),
+                std::max(j_begin, o.j_begin), std::min(j_end, o.j_end)};
+    }
+
+    // Split the part of this box that is not covered by inner (a sub-box) into at most four
+    // disjoint strips: full-height left/right strips and bottom/top strips in between.
+    // Returns the number of non-empty strips written to strips.
+    int subtract(const Box &inner_box, Box strips[4]) const {
+        Box inner = intersect(inner_box);
+        if (inner.empty()) {
+            strips[0] = *this;
+            return empty() ? 0 : 1;
+        }
+        Box candidates[4] = {
+            {i_begin, inner.i_begin, j_begin, j_end},
+            {inner.i_end, i_end, j_begin, j_end},
+            {inner.i_begin, inner.i_end, j_begin, inner.j_begin},
+            {inner.i_begin, inner.i_end, inner.j_end, j_end},
+        };
+        int n = 0;
+        for (const Box &c : candidates) {
+            if (!c.empty()) strips[n++] = c;
+        }
+        return n;
+    }
+};
+
+
+// Ghost-padded 2D field owned by one rank of a Decomp2D.
+// Storage is a single 64-byte aligned buffer of (nx + 2*nghost) x (ny + 2*nghost) values in the
+// same layout as HaloExchange expects: x-layers of ny + 2*nghost contiguous y-values, i.e.
+// value (i, j) lives at (i + nghost) * stride + (j + nghost).
+template <typename T>
+class Field2D
+{
+public:
+    static constexpr std::size_t alignment = 64; // bytes, one cache line / one AVX-512 register
+
+private:
+    struct AlignedFree { void operator()(T *p) const { std::free(p); } };
+
+    int nx_, ny_, nghost_;
+    int i0_, j0_; // global index of the first owned cell
+    int stride_; // distance between two consecutive x-layers
+    std::size_t size_; // number of values including ghost cells
+    std::unique_ptr<T[], AlignedFree> data_;
+
+    void allocate() {
+        std::size_t bytes = size_ * sizeof(T);
+        bytes = (bytes + alignment - 1) / alignment * alignment; // aligned_alloc needs a multiple of the alignment
+        T *p = static_cast<T*>(std::aligned_alloc(alignment, std::max(bytes, alignment)));
+        if (!p) throw std::bad_alloc();
+        data_.reset(p);
+    }
+
+public:
+    Field2D(int nx, int ny, int nghost, int i0 = 0, int j0 = 0)
+        : nx_(nx), ny_(ny), nghost_(nghost), i0_(i0), j0_(j0), stride_(ny + 2*nghost),
+          size_(static_cast<std::size_t>(nx + 2*nghost) * (ny + 2*nghost))
+    {
+        allocate();
+        fill(T(0));
+    }
+
+    explicit Field2D(const Decomp2D &decomp)
+        : Field2D(decomp.nx(), decomp.ny(), decomp.nghost(), decomp.i0(), decomp.j0()) {}
+
+    Field2D(const Field2D &other)
+        : nx_(other.nx_), ny_(other.ny_), nghost_(other.nghost_), i0_(other.i0_), j0_(other.j0_),
+          stride_(other.stride_), size_(other.size_)
+    {
+        allocate();
+        const int layers = nx_ + 2*nghost_;
+        const T *src = other.data();
+        T *dst = data();
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(size_) >= parallel::min_parallel))
+        for (int l = 0; l < layers; ++l) {
+            std::copy(src + static_cast<std::size_t>(l) * stride_, src + static_cast<std::size_t>(l + 1) * stride_,
+                      dst + static_cast<std::size_t>(l) * stride_);
+        }
+    }
+
+    Field2D& operator=(const Field2D &other) {
+        if (this != &other) {
+            Field2D tmp(other);
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    Field2D(Field2D&&) noexcept = default;
+    Field2D& operator=(Field2D&&) noexcept = default;
+
+    // Access by local index, (0, 0) is the first owned cell, ghosts are at -nghost..-1 and nx..nx+nghost-1
+    T& operator()(int i, int j) { return data_[index(i, j)]; }
+    const T& operator()(int i, int j) const { return data_[index(i, j)]; }
+
+    // Position of local cell (i, j) in the padded buffer
+    std::size_t index(int i, int j) const {
+        return static_cast<std::size_t>(i + nghost_) * stride_ + (j + nghost_);
+    }
+
+    // Pointer to the first value of x-layer i at local y-index j (for kernels working on rows)
+    T* row(int i, int j = 0) { return data_.get() + index(i, j); }
+    const T* row(int i, int j = 0) const { return data_.get() + index(i, j); }
+
+    // Threaded by x-layers like the kernels, so the first touch of a new field (the constructor
+    // fills it) places each page on the NUMA node of the thread that will later work on it
+    void fill(T value) {
+        const int layers = nx_ + 2*nghost_;
+        T *p = data_.get();
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(size_) >= parallel::min_parallel))
+        for (int l = 0; l < layers; ++l) {
+            std::fill(p + static_cast<std::size_t>(l) * stride_, p + static_cast<std::size_t>(l + 1) * stride_, value);
+        }
+    }
+
+    // Local <-> global index offsets, O(1)
+    int global_i(int i) const { return i0_ + i; }
+    int global_j(int j) const { return j0_ + j; }
+    int local_i(int gi) const { return gi - i0_; }
+    int local_j(int gj) const { return gj - j0_; }
+
+    // Views of the owned cells and of the ghost layers, as boxes of local indices
+    Box interior() const { return {0, nx_, 0, ny_}; }
+    Box with_ghosts() const { return interior().grow(nghost_); }
+    Box ghost_left() const { return {-nghost_, 0, 0, ny_}; }
+    Box ghost_right() const { return {nx_, nx_ + nghost_, 0, ny_}; }
+    Box ghost_bottom() const { return {0, nx_, -nghost_, 0}; }
+    Box ghost_top() const { return {0, nx_, ny_, ny_ + nghost_}; }
+
+    T* data() { return data_.get(); }
+    const T* data() const { return data_.get(); }
+    std::size_t size() const { return size_; }
+    int stride() const { return stride_; }
+    int nx() const { return nx_; }
+    int ny() const { return ny_; }
+    int nghost() const { return nghost_; }
+    int i0() const { return i0_; }
+    int j0() const { return j0_; }
+};
@@ -0,0 +1,174 @@
+#pragma once
+#include <mpi.h>
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include "decomp3d.hpp"
+#include "parallel.hpp"
+
+
+// Half-open box of local indices [i_begin, i_end) x [j_begin, j_end) x [k_begin, k_end),
+// the 3D counterpart of Box. Local indices are relative to the first owned cell of a Field3D.
+struct Box3D
+{
+    int i_begin, i_end, j_begin, j_end, k_begin, k_end;
+
+    bool empty() const { return i_end <= i_begin || j_end <= j_begin || k_end <= k_begin; }
+    long long count() const {
+        return empty() ? 0 : static_cast<long long>(i_end - i_begin) * (j_end - j_begin) * (k_end - k_begin);
+    }
+
+    // Box grown by g cells on every side (shrunk for negative g)
+    Box3D grow(int g) const { return {i_begin - g, i_end + g, j_begin - g, j_end + g, k_begin - g, k_end + g}; }
+
+    Box3D intersect(const Box3D &o) const {
+        return {std::max(i_begin, o.i_begin), std::min(i_end, o.i_end),
+                std::max(j_begin, o.j_begin), std::min(j_end, o.j_end),
+                std::max(k_begin, o.k_begin), std::min(k_end, o.k_end)};
+    }
+
+    // Split the part of this box that is not covered by inner (a sub-box) into at most six
+    // disjoint slabs: full x-slabs, y-slabs within the inner x-range, and z-slabs within the
+    // inner x- and y-range. Returns the number of non-empty slabs written to slabs.
+    int subtract(const Box3D &inner_box, Box3D slabs[6]) const {
+        Box3D inner = intersect(inner_box);
+        if (inner.empty()) {
+            slabs[0] = *this;
+            return empty() ? 0 : 1;
+        }
+        Box3D candidates[6] = {
+            {i_begin, inner.i_begin, j_begin, j_end, k_begin, k_end},
+            {inner.i_end, i_end, j_begin, j_end, k_begin, k_end},
+            {inner.i_begin, inner.i_end, j_begin, inner.j_begin, k_begin, k_end},
+            {inner.i_begin, inner.i_end, inner.j_end, j_end, k_begin, k_end},
+            {inner.i_begin, inner.i_end, inner.j_begin, inner.j_end, k_begin, inner.k_begin},
+            {inner.i_begin, inner.i_end, inner.j_begin, inner.j_end, inner.k_end, k_end},
+        };
+        int n = 0;
+        for (const Box3D &c : candidates) {
+            if (!c.empty()) slabs[n++] = c;
+        }
+        return n;
+    }
+};
+
+
+// Ghost-padded 3D field owned by one rank of a Decomp3D.
+// Storage is a single 64-byte aligned buffer of (nx + 2*nghost) x (ny + 2*nghost) x (nz + 2*nghost)
+// values with z contiguous: value (i, j, k) lives at
+// (i + nghost) * stride_i + (j + nghost) * stride_j + (k + nghost), stride_j = nz + 2*nghost.
+template <typename T>
+class Field3D
+{
+public:
+    static constexpr std::size_t alignment = 64; // bytes, one cache line / one AVX-512 register
+
+private:
+    struct AlignedFree { void operator()(T *p) const { std::free(p); } };
+
+    int nx_, ny_, nz_, nghost_;
+    int i0_, j0_, k0_; // global index of the first owned cell
+    std::size_t stride_i_; // distance between two consecutive x-layers
+    int stride_j_; // distance between two consecutive z-rows of an x-layer
+    std::size_t size_; // number of values including ghost cells
+    std::unique_ptr<T[], AlignedFree> data_;
+
+    void allocate() {
+        std::size_t bytes = size_ * sizeof(T);
+        bytes = (bytes + alignment - 1) / alignment * alignment; // aligned_alloc needs a multiple of the alignment
+        T *p = static_cast<T*>(std::aligned_alloc(alignment, std::max(bytes, alignment)));
+        if (!p) throw std::bad_alloc();
+        data_.reset(p);
+    }
+
+public:
+    Field3D(int nx, int ny, int nz, int nghost, int i0 = 0, int j0 = 0, int k0 = 0)
+        : nx_(nx), ny_(ny), nz_(nz), nghost_(nghost), i0_(i0), j0_(j0), k0_(k0),
+          stride_i_(static_cast<std::size_t>(ny + 2*nghost) * (nz + 2*nghost)), stride_j_(nz + 2*nghost),
+          size_(static_cast<std::size_t>(nx + 2*nghost) * stride_i_)
+    {
+        allocate();
+        fill(T(0));
+    }
+
+    explicit Field3D(const Decomp3D &decomp)
+        : Field3D(decomp.nx(), decomp.ny(), decomp.nz(), decomp.nghost(), decomp.i0(), decomp.j0(), decomp.k0()) {}
+
+    Field3D(const Field3D &other)
+        : nx_(other.nx_), ny_(other.ny_), nz_(other.nz_), nghost_(other.nghost_),
+          i0_(other.i0_), j0_(other.j0_), k0_(other.k0_),
+          stride_i_(other.stride_i_), stride_j_(other.stride_j_), size_(other.size_)
+    {
+        allocate();
+        const int layers = nx_ + 2*nghost_;
+        const T *src = other.data();
+        T *dst = data();
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(size_) >= parallel::min_parallel))
+        for (int l = 0; l < layers; ++l) {
+            std::copy(src + l * stride_i_, src + (l + 1) * stride_i_, dst + l * stride_i_);
+        }
+    }
+
+    Field3D& operator=(const Field3D &other) {
+        if (this != &other) {
+            Field3D tmp(other);
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    Field3D(Field3D&&) noexcept = default;
+    Field3D& operator=(Field3D&&) noexcept = default;
+
+    // Access by local index, (0, 0, 0) is the first owned cell, ghosts are at -nghost..-1 and n..n+nghost-1
+    T& operator()(int i, int j, int k) { return data_[index(i, j, k)]; }
+    const T& operator()(int i, int j, int k) const { return data_[index(i, j, k)]; }
+
+    // Position of local cell (i, j, k) in the padded buffer
+    std::size_t index(int i, int j, int k) const {
+        return static_cast<std::size_t>(i + nghost_) * stride_i_
+             + static_cast<std::size_t>(j + nghost_) * stride_j_ + (k + nghost_);
+    }
+
+    // Pointer to the z-row (i, j) at local z-index k (for kernels working on rows)
+    T* row(int i, int j, int k = 0) { return data_.get() + index(i, j, k); }
+    const T* row(int i, int j, int k = 0) const { return data_.get() + index(i, j, k); }
+
+    // Threaded by x-layers like the kernels (first touch places pages near their threads)
+    void fill(T value) {
+        const int layers = nx_ + 2*nghost_;
+        T *p = data_.get();
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(size_) >= parallel::min_parallel))
+        for (int l = 0; l < layers; ++l) {
+            std::fill(p + l * stride_i_, p + (l + 1) * stride_i_, value);
+        }
+    }
+
+    // Local <-> global index offsets, O(1)
+    int global_i(int i) const { return i0_ + i; }
+    int global_j(int j) const { return j0_ + j; }
+    int global_k(int k) const { return k0_ + k; }
+    int local_i(int gi) const { return gi - i0_; }
+    int local_j(int gj) const { return gj - j0_; }
+    int local_k(int gk) const { return gk - k0_; }
+
+    // Views of the owned cells, with and without the ghost layers
+    Box3D interior() const { return {0, nx_, 0, ny_, 0, nz_}; }
+    Box3D with_ghosts() const { return interior().grow(nghost_); }
+
+    T* data() { return data_.get(); }
+    const T* data() const { return data_.get(); }
+    std::size_t size() const { return size_; }
+    std::size_t stride_i() const { return stride_i_; }
+    int stride_j() const { return stride_j_; }
+    int nx() const { return nx_; }
+    int ny() const { return ny_; }
+    int nz() const { return nz_; }
+    int nghost() const { return nghost_; }
+    int i0() const { return i0_; }
+    int j0() const { return j0_; }
+    int k0() const { return k0_; }
+};
@@ -0,0 +1,282 @@
+#pragma once
+#include <mpi.h>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "decomp2d.hpp"
+#include "field2d.hpp"
+#include "mpiTraits.hpp"
+#ifdef PDE_HAVE_PARALLEL_HDF5
+#include <hdf5.h>
+#endif
+
+
+// Collective parallel I/O of distributed Field2D data, without gathering to one rank.
+//
+// Raw format: a fixed header followed, at header.data_offset, by the Nx x Ny global values
+// in the same order as Field2D (x slow, y contiguous) in native byte order. Every rank writes
+// its owned block straight out of the padded field: the file view is a subarray of the global
+// array at (i0, j0) and the memory type a subarray of the padded field that skips the ghost
+// cells, so MPI-IO strips them without an intermediate copy. A file written on one process
+// grid can be read on any other (the layout only depends on Nx, Ny).
+//
+// With parallel HDF5 (PDE_HAVE_PARALLEL_HDF5) the same hyperslab selections write an
+// Nx x Ny dataset with collective transfers.
+namespace fieldio
+{
+
+struct FileHeader
+{
+    char magic[8]; // "PDEFIELD"
+    std::int32_t version;
+    std::int32_t value_size; // bytes per value, 4 (float) or 8 (double)
+    std::int64_t Nx, Ny;
+    std::int64_t data_offset; // bytes from the start of the file to the first value
+};
+
+constexpr char magic[8] = {'P', 'D', 'E', 'F', 'I', 'E', 'L', 'D'};
+constexpr std::int32_t version = 1;
+constexpr std::int64_t data_offset = 64; // header padded to a cache line
+
+// Subarray types describing the owned block of a field in the global file array and in the
+// padded memory of the field
+template <typename T>
+class BlockTypes
+{
+    MPI_Datatype file_ = MPI_DATATYPE_NULL, memory_ = MPI_DATATYPE_NULL;
+
+public:
+    BlockTypes(const Decomp2D &decomp, const Field2D<T> &u) {
+        int global[2] = {decomp.Nx(), decomp.Ny()};
+        int local[2] = {decomp.nx(), decomp.ny()};
+        int start[2] = {decomp.i0(), decomp.j0()};
+        MPI_Type_create_subarray(2, global, local, start, MPI_ORDER_C, mpi_type<T>(), &file_);
+        int padded[2] = {u.nx() + 2*u.nghost(), u.ny() + 2*u.nghost()};
+        int first[2] = {u.nghost(), u.nghost()};
+        MPI_Type_create_subarray(2, padded, local, first, MPI_ORDER_C, mpi_type<T>(), &memory_);
+        MPI_Type_commit(&file_);
+        MPI_Type_commit(&memory_);
+    }
+
+    BlockTypes(const BlockTypes&) = delete;
+    BlockTypes& operator=(const BlockTypes&) = delete;
+
+    ~BlockTypes() {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (finalized) return;
+        MPI_Type_free(&file_);
+        MPI_Type_free(&memory_);
+    }
+
+    MPI_Datatype file() const { return file_; }
+    MPI_Datatype memory() const { return memory_; }
+};
+
+// Abort with a message when an MPI-IO call failed (file operations return errors by default)
+inline void check(int err, const char *what, const std::string &path, MPI_Comm comm) {
+    if (err == MPI_SUCCESS) return;
+    char msg[MPI_MAX_ERROR_STRING];
+    int len = 0;
+    MPI_Error_string(err, msg, &len);
+    std::cerr << "Error: " << what << " '" << path << "' failed: " << msg << std::endl;
+    MPI_Abort(comm, 1);
+}
+
+// The field must match the decomposition
+template <typename T>
+void check_field(const Decomp2D &decomp, const Field2D<T> &u) {
+    if (u.nx() != decomp.nx() || u.ny() != decomp.ny() || u.i0() != decomp.i0() || u.j0() != decomp.j0()) {
+        std::cerr << "Error: Field2D of size " << u.nx() << "x" << u.ny() << " does not match the decomposition" << std::endl;
+        MPI_Abort(decomp.comm(), 1);
+    }
+}
+
+// Write the owned cells of u on all ranks of decomp to path (collective, overwrites the file)
+template <typename T>
+void write_raw(const std::string &path, const Decomp2D &decomp, const Field2D<T> &u) {
+    check_field(decomp, u);
+    MPI_Comm comm = decomp.comm();
+    MPI_File fh;
+    check(MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh),
+          "opening", path, comm);
+    check(MPI_File_set_size(fh, 0), "truncating", path, comm);
+
+    if (decomp.rank() == 0) {
+        FileHeader header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.value_size = sizeof(T);
+        header.Nx = decomp.Nx();
+        header.Ny = decomp.Ny();
+        header.data_offset = data_offset;
+        check(MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE), "writing", path, comm);
+    }
+
+    BlockTypes<T> types(decomp, u);
+    char native[] = "native";
+    MPI_File_set_view(fh, data_offset, mpi_type<T>(), types.file(), native, MPI_INFO_NULL);
+    check(MPI_File_write_all(fh, u.data(), 1, types.memory(), MPI_STATUS_IGNORE), "writing", path, comm);
+    MPI_File_close(&fh);
+}
+
+// Header of a raw field file, read by rank 0 and broadcast (collective)
+inline FileHeader read_header(const std::string &path, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_File fh;
+    check(MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh), "opening", path, comm);
+    FileHeader header{};
+    if (rank == 0) {
+        check(MPI_File_read_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE), "reading", path, comm);
+    }
+    MPI_Bcast(&header, sizeof(header), MPI_BYTE, 0, comm);
+    MPI_File_close(&fh);
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+        if (rank == 0) std::cerr << "Error: '" << path << "' is not a field file of version " << version << std::endl;
+        MPI_Abort(comm, 1);
+    }
+    return header;
+}
+
+// Read the owned cells of u from a file written by write_raw on any process grid (collective).
+// The ghost cells of u are left untouched.
+template <typename T>
+void read_raw(const std::string &path, const Decomp2D &decomp, Field2D<T> &u) {
+    check_field(decomp, u);
+    MPI_Comm comm = decomp.comm();
+    FileHeader header = read_header(path, comm);
+    if (header.Nx != decomp.Nx() || header.Ny != decomp.Ny() || header.value_size != static_cast<int>(sizeof(T))) {
+        if (decomp.rank() == 0) {
+            std::cerr << "Error: '" << path << "' holds a " << header.Nx << "x" << header.Ny << " field of "
+                      << header.value_size << "-byte values, expected " << decomp.Nx() << "x" << decomp.Ny()
+                      << " of " << sizeof(T) << "-byte values" << std::endl;
+        }
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_File fh;
+    check(MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh), "opening", path, comm);
+    BlockTypes<T> types(decomp, u);
+    char native[] = "native";
+    MPI_File_set_view(fh, header.data_offset, mpi_type<T>(), types.file(), native, MPI_INFO_NULL);
+    check(MPI_File_read_all(fh, u.data(), 1, types.memory(), MPI_STATUS_IGNORE), "reading", path, comm);
+    MPI_File_close(&fh);
+}
+
+#ifdef PDE_HAVE_PARALLEL_HDF5
+
+template <typename T> inline hid_t hdf5_type();
+template <> inline hid_t hdf5_type<float>() { return H5T_NATIVE_FLOAT; }
+template <> inline hid_t hdf5_type<double>() { return H5T_NATIVE_DOUBLE; }
+
+namespace detail
+{
+
+// Collective transfer of the owned block of u to the Nx x Ny dataset dset, or from it into
+// read_buf (the buffer of u) when given
+template <typename T>
+herr_t transfer_hdf5(hid_t dset, const Decomp2D &decomp, const Field2D<T> &u, T *read_buf = nullptr) {
+    hsize_t global[2] = {static_cast<hsize_t>(decomp.Nx()), static_cast<hsize_t>(decomp.Ny())};
+    hsize_t start[2] = {static_cast<hsize_t>(decomp.i0()), static_cast<hsize_t>(decomp.j0())};
+    hsize_t count[2] = {static_cast<hsize_t>(decomp.nx()), static_cast<hsize_t>(decomp.ny())};
+    hsize_t padded[2] = {static_cast<hsize_t>(u.nx() + 2*u.nghost()), static_cast<hsize_t>(u.ny() + 2*u.nghost())};
+    hsize_t first[2] = {static_cast<hsize_t>(u.nghost()), static_cast<hsize_t>(u.nghost())};
+
+    hid_t filespace = H5Screate_simple(2, global, nullptr);
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, nullptr, count, nullptr);
+    hid_t memspace = H5Screate_simple(2, padded, nullptr);
+    H5Sselect_hyperslab(memspace, H5S_SELECT_SET, first, nullptr, count, nullptr);
+    hid_t dxpl = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(dxpl, H5FD_MPIO_COLLECTIVE);
+    herr_t err = read_buf ? H5Dread(dset, hdf5_type<T>(), memspace, filespace, dxpl, read_buf)
+                          : H5Dwrite(dset, hdf5_type<T>(), memspace, filespace, dxpl, u.data());
+    H5Pclose(dxpl);
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    return err;
+}
+
+inline hid_t file_access(MPI_Comm comm) {
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(fapl, comm, MPI_INFO_NULL);
+    return fapl;
+}
+
+} // namespace detail
+
+// Write the owned cells of u as the Nx x Ny dataset `name` of a new HDF5 file (collective)
+template <typename T>
+void write_hdf5(const std::string &path, const Decomp2D &decomp, const Field2D<T> &u, const std::string &name = "u") {
+    check_field(decomp, u);
+    hid_t fapl = detail::file_access(decomp.comm());
+    hid_t file = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+    H5Pclose(fapl);
+    if (file < 0) check(MPI_ERR_FILE, "creating", path, decomp.comm());
+    hsize_t global[2] = {static_cast<hsize_t>(decomp.Nx()), static_cast<hsize_t>(decomp.Ny())};
+    hid_t space = H5Screate_simple(2, global, nullptr);
+    hid_t dset = H5Dcreate2(file, name.c_str(), hdf5_type<T>(), space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    H5Sclose(space);
+    herr_t err = detail::transfer_hdf5(dset, decomp, u);
+    H5Dclose(dset);
+    H5Fclose(file);
+    if (err < 0) check(MPI_ERR_IO, "writing", path, decomp.comm());
+}
+
+// Read the dataset `name` of an HDF5 file written on any process grid into the owned cells of u
+template <typename T>
+void read_hdf5(const std::string &path, const Decomp2D &decomp, Field2D<T> &u, const std::string &name = "u") {
+    check_field(decomp, u);
+    hid_t fapl = detail::file_access(decomp.comm());
+    hid_t file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, fapl);
+    H5Pclose(fapl);
+    if (file < 0) check(MPI_ERR_FILE, "opening", path, decomp.comm());
+    hid_t dset = H5Dopen2(file, name.c_str(), H5P_DEFAULT);
+    herr_t err = dset < 0 ? -1 : detail::transfer_hdf5(dset, decomp, u, u.data());
+    if (dset >= 0) H5Dclose(dset);
+    H5Fclose(file);
+    if (err < 0) check(MPI_ERR_IO, "reading", path, decomp.comm());
+}
+
+#endif // PDE_HAVE_PARALLEL_HDF5
+
+// Whether write() can produce HDF5 files in this build
+constexpr bool have_hdf5() {
+#ifdef PDE_HAVE_PARALLEL_HDF5
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Format of an output file: "raw", "hdf5", or "auto" for HDF5 when the path ends in .h5 or
+// .hdf5 and raw otherwise
+inline bool use_hdf5(const std::string &path, const std::string &format) {
+    if (format != "auto") return format == "hdf5";
+    auto ends_with = [&](const char *ext) {
+        std::size_t n = std::strlen(ext);
+        return path.size() >= n && path.compare(path.size() - n, n, ext) == 0;
+    };
+    return ends_with(".h5") || ends_with(".hdf5");
+}
+
+// Write u with the writer of the chosen format (collective); aborts if HDF5 is asked for in a
+// build without it
+template <typename T>
+void write(const std::string &path, const Decomp2D &decomp, const Field2D<T> &u, const std::string &format = "auto") {
+    if (!use_hdf5(path, format)) {
+        write_raw(path, decomp, u);
+        return;
+    }
+#ifdef PDE_HAVE_PARALLEL_HDF5
+    write_hdf5(path, decomp, u);
+#else
+    if (decomp.rank() == 0) {
+        std::cerr << "Error: '" << path << "' needs HDF5 output, configure with -DENABLE_HDF5=ON and a parallel HDF5" << std::endl;
+    }
+    MPI_Abort(decomp.comm(), 1);
+#endif
+}
+
+} // namespace fieldio
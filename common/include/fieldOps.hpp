@@ -0,0 +1,135 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <cmath>
+#include "field2d.hpp"
+#include "parallel.hpp"
+
+
+// BLAS-1 style operations on Field2D restricted to a Box of local indices.
+// Cells outside the box are neither read nor written. Local sums are accumulated in double.
+// Large boxes are split over the OpenMP threads of the rank by x-layers.
+namespace fieldops
+{
+
+// Local part of <a, b> over the box (no communication)
+template <typename T>
+double local_dot(const Field2D<T> &a, const Field2D<T> &b, const Box &box) {
+    double sum = 0.0;
+    PDE_OMP(parallel for schedule(static) reduction(+:sum) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const T *pa = a.row(i), *pb = b.row(i);
+        for (int j = box.j_begin; j < box.j_end; ++j) sum += static_cast<double>(pa[j]) * pb[j];
+    }
+    return sum;
+}
+
+// Global <a, b> over the boxes of all ranks of comm
+template <typename T>
+double dot(const Field2D<T> &a, const Field2D<T> &b, const Box &box, MPI_Comm comm) {
+    double local = local_dot(a, b, box), global = 0.0;
+    MPI_Allreduce(&local, &global, 1, MPI_DOUBLE, MPI_SUM, comm);
+    return global;
+}
+
+template <typename T>
+double norm2(const Field2D<T> &a, const Box &box, MPI_Comm comm) {
+    return std::sqrt(dot(a, a, box, comm));
+}
+
+// Local part of max |a| over the box
+template <typename T>
+double local_max_abs(const Field2D<T> &a, const Box &box) {
+    double m = 0.0;
+    PDE_OMP(parallel for schedule(static) reduction(max:m) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const T *pa = a.row(i);
+        for (int j = box.j_begin; j < box.j_end; ++j) m = std::max(m, static_cast<double>(std::abs(pa[j])));
+    }
+    return m;
+}
+
+// y += alpha * x
+template <typename T>
+void axpy(T alpha, const Field2D<T> &x, Field2D<T> &y, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const T *px = x.row(i);
+        T *py = y.row(i);
+        for (int j = box.j_begin; j < box.j_end; ++j) py[j] += alpha * px[j];
+    }
+}
+
+// y = x + beta * y
+template <typename T>
+void xpay(const Field2D<T> &x, T beta, Field2D<T> &y, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const T *px = x.row(i);
+        T *py = y.row(i);
+        for (int j = box.j_begin; j < box.j_end; ++j) py[j] = px[j] + beta * py[j];
+    }
+}
+
+// y = alpha * x + beta * y
+template <typename T>
+void axpby(T alpha, const Field2D<T> &x, T beta, Field2D<T> &y, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const T *px = x.row(i);
+        T *py = y.row(i);
+        for (int j = box.j_begin; j < box.j_end; ++j) py[j] = alpha * px[j] + beta * py[j];
+    }
+}
+
+// y = x
+template <typename T>
+void copy(const Field2D<T> &x, Field2D<T> &y, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        std::copy(x.row(i, box.j_begin), x.row(i, box.j_end), y.row(i, box.j_begin));
+    }
+}
+
+// y = alpha * x
+template <typename T>
+void scale(T alpha, const Field2D<T> &x, Field2D<T> &y, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const T *px = x.row(i);
+        T *py = y.row(i);
+        for (int j = box.j_begin; j < box.j_end; ++j) py[j] = alpha * px[j];
+    }
+}
+
+// y = alpha * x rounded to the precision of y (e.g. double -> float for a low precision solve)
+template <typename S, typename T>
+void convert(const Field2D<S> &x, Field2D<T> &y, const Box &box, double alpha = 1.0) {
+    PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const S *px = x.row(i);
+        T *py = y.row(i);
+        for (int j = box.j_begin; j < box.j_end; ++j) py[j] = static_cast<T>(alpha * px[j]);
+    }
+}
+
+// y += alpha * x computed in double, with x of another precision than y
+template <typename S, typename T>
+void add_converted(double alpha, const Field2D<S> &x, Field2D<T> &y, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        const S *px = x.row(i);
+        T *py = y.row(i);
+        for (int j = box.j_begin; j < box.j_end; ++j) py[j] = static_cast<T>(py[j] + alpha * static_cast<double>(px[j]));
+    }
+}
+
+template <typename T>
+void set(Field2D<T> &y, T value, const Box &box) {
+    PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        std::fill(y.row(i, box.j_begin), y.row(i, box.j_end), value);
+    }
+}
+
+} // namespace fieldops
@@ -1,29 +1,87 @@
 #pragma once
 #include <mpi.h>
 #include <iostream>
+#include "batchField2d.hpp"
 #include "decomp2d.hpp"
+#include "field2d.hpp"
+#include "mpiTraits.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
 #include <vector>
 
 
+// How ghost layers travel between neighbours:
+//  Packed   - copy each face into a contiguous buffer, send it, and copy it back out
+//  Datatype - describe the (strided) faces with MPI derived datatypes committed once in the
+//             constructor and send directly out of / into U, without pack/unpack loops
+enum class HaloMode { Packed, Datatype };
 
+template <typename T> class PersistentHalo;
+
+// Ghost layer exchange of fields of scalar type T (float by default) on a Decomp2D.
+// Works on Field2D<T> or on a flat std::vector<T> with the same padded layout. With
+// components = B every cell holds B contiguous values (BatchField2D with batch B): a face then
+// travels in the same messages as for one field, each B times larger.
+//
+// By default only the four faces are exchanged and the corner ghost cells are left untouched.
+// With corners = true the exchange runs in two phases: first the x-faces, then the y-faces
+// extended over the x ghost layers, so the corner (diagonal neighbour) ghost cells are filled
+// as well. The second phase can only start once the first one has arrived, so less of the
+// exchange overlaps with computation between begin() and finish().
+//
+// begin_color()/finish_color() exchange only the face ghost cells of one colour of the
+// red-black ordering ((global i + global j) % 2 == color), half of a full exchange, for
+// in-place red-black sweeps that only read the other colour. These are always packed.
+template <typename T = float>
 class HaloExchange
 {
+    friend class PersistentHalo<T>;
+
     MPI_Comm comm_;
     int rank_, size_;
     int left_, right_, up_, down_;
     int nghost_;
     int local_nx_, local_ny_; // local grid size without ghost cells
+    int components_; // values per cell
     //int i0_, j0_; // global index of the first local grid point (excluding ghost cells)
     //int global_nx_, global_ny_; // global grid size
-    std::vector<float> send_column_left, send_column_right, recv_column_left, recv_column_right;
-    std::vector<float> send_row_top, send_row_bottom, recv_row_top, recv_row_bottom;
+    std::vector<T> send_column_left, send_column_right, recv_column_left, recv_column_right;
+    std::vector<T> send_row_top, send_row_bottom, recv_row_top, recv_row_bottom;
     const int tag_x_l2r = 10; // tag for left to right communication
     const int tag_x_r2l = 11; // tag for right to left communication
     const int tag_y_b2t = 12; // tag for bottom to top communication
     const int tag_y_t2b = 13; // tag for top to bottom communication
+    MPI_Request requests_[8]; // in-flight requests of a split-phase exchange (4 recv + 4 send)
+    int num_requests_ = 0;
+    bool in_flight_ = false; // the pack buffers are shared by begin/finish and all PersistentHalo
+    HaloMode mode_;
+    bool corners_;
+    int row_len_; // length of the y-faces: local_nx, or local_nx + 2*nghost with corners
+    int row_pad_i0_; // padded x-index where the y-faces start: nghost, or 0 with corners
+    MPI_Datatype column_type_ = MPI_DATATYPE_NULL; // nghost x-layers of local_ny contiguous cells
+    MPI_Datatype row_type_ = MPI_DATATYPE_NULL; // row_len blocks of nghost cells, strided by an x-layer
+    // Colour exchange: the colouring must agree across a periodic wrap, i.e. N even there
+    bool colorable_;
+    int color_ = -1; // colour in flight
+    std::vector<T> color_send_[4], color_recv_[4]; // left, right, down, up
+
+    // Faces selected for packing / posting
+    static constexpr int faces_x = 1;
+    static constexpr int faces_y = 2;
+    static constexpr int faces_all = faces_x | faces_y;
+
+    // One message pair with a neighbour: what is sent to it and where its data is received
+    struct Message {
+        int neighbor;
+        T *send_buf, *recv_buf;
+        int count;
+        MPI_Datatype type;
+        int send_tag, recv_tag;
+    };
 
 public:
-    HaloExchange(const Decomp2D &decomp){
+    HaloExchange(const Decomp2D &decomp, HaloMode mode = HaloMode::Packed, bool corners = false, int components = 1)
+        : components_(components), mode_(mode), corners_(corners) {
         comm_ = decomp.comm();
         rank_ = decomp.rank();
         size_ = decomp.size();
@@ -38,89 +96,497 @@ public:
         // j0_ = decomp.j0();
         // global_nx_ = decomp.Nx();
         // global_ny_ = decomp.Ny();
-        send_column_left.resize(nghost_ * local_ny_);
-        recv_column_left.resize(nghost_ * local_ny_);
-        send_column_right.resize(nghost_ * local_ny_);
-        recv_column_right.resize(nghost_ * local_ny_);
-        send_row_top.resize(nghost_ * local_nx_);
-        recv_row_top.resize(nghost_ * local_nx_);
-        send_row_bottom.resize(nghost_ * local_nx_);
-        recv_row_bottom.resize(nghost_ * local_nx_);
+        colorable_ = !(decomp.periodic_x() && decomp.Nx() % 2 != 0) && !(decomp.periodic_y() && decomp.Ny() % 2 != 0);
+        row_len_ = corners_ ? local_nx_ + 2*nghost_ : local_nx_;
+        row_pad_i0_ = corners_ ? 0 : nghost_;
+        if (mode_ == HaloMode::Packed) {
+            send_column_left.resize(nghost_ * local_ny_ * components_);
+            recv_column_left.resize(nghost_ * local_ny_ * components_);
+            send_column_right.resize(nghost_ * local_ny_ * components_);
+            recv_column_right.resize(nghost_ * local_ny_ * components_);
+            send_row_top.resize(nghost_ * row_len_ * components_);
+            recv_row_top.resize(nghost_ * row_len_ * components_);
+            send_row_bottom.resize(nghost_ * row_len_ * components_);
+            recv_row_bottom.resize(nghost_ * row_len_ * components_);
+        }
+        else if (nghost_ > 0) {
+            int stride = (local_ny_ + 2*nghost_) * components_; // Assuming row-major order
+            MPI_Type_vector(nghost_, local_ny_ * components_, stride, mpi_type<T>(), &column_type_);
+            MPI_Type_vector(row_len_, nghost_ * components_, stride, mpi_type<T>(), &row_type_);
+            MPI_Type_commit(&column_type_);
+            MPI_Type_commit(&row_type_);
+        }
+    }
+
+    // The committed datatypes and in-flight requests are owned by this object
+    HaloExchange(const HaloExchange&) = delete;
+    HaloExchange& operator=(const HaloExchange&) = delete;
+
+    ~HaloExchange() {
+        // the object may outlive MPI_Finalize when declared in main, types are gone by then
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (finalized) return;
+        if (column_type_ != MPI_DATATYPE_NULL) MPI_Type_free(&column_type_);
+        if (row_type_ != MPI_DATATYPE_NULL) MPI_Type_free(&row_type_);
+    }
+
+    HaloMode mode() const { return mode_; }
+    bool corners() const { return corners_; }
+    int components() const { return components_; }
+
+    // Blocking exchange: begin() immediately followed by finish()
+    void exchange(std::vector<T> &U) {
+        PDE_PROFILE_SCOPE("halo.exchange");
+        begin(U);
+        finish(U);
+    }
+
+    void exchange(Field2D<T> &U) {
+        PDE_PROFILE_SCOPE("halo.exchange");
+        begin(U);
+        finish(U);
+    }
+
+    void exchange(BatchField2D<T> &U) {
+        PDE_PROFILE_SCOPE("halo.exchange");
+        begin(U);
+        finish(U);
+    }
+
+    // Split-phase exchange, first half: pack the boundary layers of U and post non-blocking
+    // receives and sends. Until finish() is called U must not be modified, but its interior
+    // can be read, e.g. to update the part of the stencil that does not touch ghost cells.
+    void begin(std::vector<T> &U) {
+        check_size(U);
+        begin(U.data());
+    }
+
+    void begin(Field2D<T> &U) {
+        check_size(U);
+        begin(U.data());
+    }
+
+    void begin(BatchField2D<T> &U) {
+        check_size(U);
+        begin(U.data());
+    }
+
+    // Split-phase exchange, second half: wait for the messages posted by begin() and unpack
+    // the received ghost layers. U must be the same array that was passed to begin().
+    void finish(std::vector<T> &U) { finish(U.data()); }
+    void finish(Field2D<T> &U) { finish(U.data()); }
+    void finish(BatchField2D<T> &U) { finish(U.data()); }
+
+    // Split-phase exchange of the face ghost cells of one colour (0: global i + j even, 1: odd)
+    void begin_color(Field2D<T> &U, int color) {
+        check_size(U);
+        if (!colorable_) {
+            std::cerr << "Error: red-black halo exchange needs an even number of points along periodic axes" << std::endl;
+            MPI_Abort(comm_, 1);
+        }
+        acquire();
+        color_ = color & 1;
+        PDE_PROFILE_SCOPE("halo.post");
+        for (int face = 0; face < 4; ++face) {
+            ColorFace cf = color_face(face);
+            if (cf.neighbor == MPI_PROC_NULL) continue;
+            std::vector<T> &recv = color_recv_[face];
+            recv.resize(static_cast<std::size_t>(cf.recv.count() + 1) / 2 + cf.recv.i_end - cf.recv.i_begin);
+            MPI_Irecv(recv.data(), static_cast<int>(recv.size()), mpi_type<T>(), cf.neighbor, cf.recv_tag, comm_,
+                      &requests_[num_requests_++]);
+        }
+        for (int face = 0; face < 4; ++face) {
+            ColorFace cf = color_face(face);
+            if (cf.neighbor == MPI_PROC_NULL) continue;
+            std::vector<T> &send = color_send_[face];
+            send.resize(static_cast<std::size_t>(cf.send.count() + 1) / 2 + cf.send.i_end - cf.send.i_begin);
+            int count = copy_color(U, cf.send, send.data(), true);
+            MPI_Isend(send.data(), count, mpi_type<T>(), cf.neighbor, cf.send_tag, comm_, &requests_[num_requests_++]);
+            PDE_PROFILE_BYTES(cf.neighbor, static_cast<long long>(count) * sizeof(T));
+        }
     }
 
-    void exchange(std::vector<float> &U) {
+    void finish_color(Field2D<T> &U) {
+        {
+            PDE_PROFILE_SCOPE("halo.wait");
+            MPI_Waitall(num_requests_, requests_, MPI_STATUSES_IGNORE);
+        }
+        num_requests_ = 0;
+        PDE_PROFILE_SCOPE("halo.unpack");
+        for (int face = 0; face < 4; ++face) {
+            ColorFace cf = color_face(face);
+            if (cf.neighbor != MPI_PROC_NULL) copy_color(U, cf.recv, color_recv_[face].data(), false);
+        }
+        color_ = -1;
+        in_flight_ = false;
+    }
+
+    void exchange_color(Field2D<T> &U, int color) {
+        PDE_PROFILE_SCOPE("halo.exchange");
+        begin_color(U, color);
+        finish_color(U);
+    }
+
+    // Whether begin_color() can be used on this decomposition
+    bool colorable() const { return colorable_; }
+
+private:
+    // One face of the colour exchange: owned layers sent and ghost layers received (local indices)
+    struct ColorFace {
+        int neighbor;
+        Box send, recv;
+        int send_tag, recv_tag;
+    };
+
+    // Face 0 left, 1 right, 2 down, 3 up; both sides walk the same global cells in the same order
+    ColorFace color_face(int face) const {
+        const int nx = local_nx_, ny = local_ny_, ng = nghost_;
+        switch (face) {
+        case 0: return {left_, Box{0, ng, 0, ny}, Box{-ng, 0, 0, ny}, tag_x_r2l, tag_x_l2r};
+        case 1: return {right_, Box{nx - ng, nx, 0, ny}, Box{nx, nx + ng, 0, ny}, tag_x_l2r, tag_x_r2l};
+        case 2: return {down_, Box{0, nx, 0, ng}, Box{0, nx, -ng, 0}, tag_y_t2b, tag_y_b2t};
+        default: return {up_, Box{0, nx, ny - ng, ny}, Box{0, nx, ny, ny + ng}, tag_y_b2t, tag_y_t2b};
+        }
+    }
+
+    // Copy the cells of colour color_ in box between U and buf (pack: U -> buf), returns their number
+    int copy_color(Field2D<T> &U, const Box &box, T *buf, bool pack) const {
+        int n = 0;
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            T *u = U.row(i);
+            // & 1 is the parity of negative (periodic ghost) global indices as well
+            for (int j = box.j_begin + ((U.global_i(i) + U.global_j(box.j_begin) + color_) & 1); j < box.j_end; j += 2) {
+                if (pack) buf[n++] = u[j];
+                else u[j] = buf[n++];
+            }
+        }
+        return n;
+    }
+
+    // Faces sent by begin(); with corners the y-faces follow in finish()
+    int first_faces() const { return corners_ ? faces_x : faces_all; }
+
+    void begin(T *U) {
+        acquire();
+        post(U, first_faces());
+    }
+
+    void finish(T *U) {
+        complete(U, first_faces());
+        if (corners_) {
+            post(U, faces_y);
+            complete(U, faces_y);
+        }
+        in_flight_ = false;
+    }
+
+    // Pack the selected faces of U and post their receives and sends
+    void post(T *U, int faces) {
+        pack(U, faces);
+        PDE_PROFILE_SCOPE("halo.post");
+        Message msgs[4];
+        int n = messages(U, msgs, faces);
+        count_bytes(msgs, n);
+        // Post the receives before the sends so incoming messages can land directly in the recv buffers
+        for(int k = 0; k < n; ++k) {
+            MPI_Irecv(msgs[k].recv_buf, msgs[k].count, msgs[k].type, msgs[k].neighbor, msgs[k].recv_tag,
+                      comm_, &requests_[num_requests_++]);
+        }
+        for(int k = 0; k < n; ++k) {
+            MPI_Isend(msgs[k].send_buf, msgs[k].count, msgs[k].type, msgs[k].neighbor, msgs[k].send_tag,
+                      comm_, &requests_[num_requests_++]);
+        }
+    }
+
+    // Wait for the posted messages and unpack the selected faces into U
+    void complete(T *U, int faces) {
+        {
+            PDE_PROFILE_SCOPE("halo.wait");
+            MPI_Waitall(num_requests_, requests_, MPI_STATUSES_IGNORE);
+        }
+        num_requests_ = 0;
+        unpack(U, faces);
+    }
+
+    void check_size(const std::vector<T> &U) const {
         int nx_tot = local_nx_ + 2*nghost_; // total local grid size including ghost cells
         int ny_tot = local_ny_ + 2*nghost_; // total local grid size including ghost cells
 
         // assert that U has the correct size
-        if (static_cast<int>(U.size()) != nx_tot * ny_tot) {
-            std::cerr << "Error: U has incorrect size. Expected " << nx_tot * ny_tot << " but got " << U.size() << std::endl;
+        if (static_cast<int>(U.size()) != nx_tot * ny_tot * components_) {
+            std::cerr << "Error: U has incorrect size. Expected " << nx_tot * ny_tot * components_ << " but got " << U.size() << std::endl;
             MPI_Abort(comm_, 1);
         }
+    }
 
-        int stride = ny_tot; // Assuming row-major order
-        // Prepare send buffers
-        for(int g=0; g < nghost_; ++g) {
-            // Prepare left and rigtht ghost layer to send
-            for(int j=0; j < local_ny_; ++j) {
-                send_column_left[g*local_ny_ + j] = U[(nghost_+ g)*stride + nghost_ + j]; // left ghost layer
-                send_column_right[g*local_ny_ + j] = U[(nghost_ + local_nx_ - nghost_ + g)*stride + nghost_ + j]; // right ghost layer
-            }
-            // Prepare top and bottom ghost layer to send
-            for(int i=0; i < local_nx_; ++i) {
-                send_row_bottom[g*local_nx_ + i] = U[(nghost_ + i)*stride + nghost_ + g]; // bottom ghost layer
-                send_row_top[g*local_nx_ + i] = U[(nghost_ + i)*stride + nghost_ + local_ny_ - nghost_ + g]; // top ghost layer
-            }
+    void check_size(const Field2D<T> &U) const {
+        if (U.nx() != local_nx_ || U.ny() != local_ny_ || U.nghost() != nghost_ || components_ != 1) {
+            std::cerr << "Error: Field2D of size " << U.nx() << "x" << U.ny() << " (nghost " << U.nghost()
+                      << ") does not match the halo of size " << local_nx_ << "x" << local_ny_
+                      << " (nghost " << nghost_ << ", " << components_ << " components)" << std::endl;
+            MPI_Abort(comm_, 1);
         }
+    }
 
-        // Perform communication with neighbors using MPI_Sendrecv
-        if(left_ != MPI_PROC_NULL && nghost_ > 0) {
-            MPI_Sendrecv(send_column_left.data(), nghost_*local_ny_, MPI_FLOAT, left_, tag_x_r2l,
-                        recv_column_left.data(), nghost_*local_ny_, MPI_FLOAT, left_, tag_x_l2r,
-                        comm_, MPI_STATUS_IGNORE);  
+    void check_size(const BatchField2D<T> &U) const {
+        if (U.nx() != local_nx_ || U.ny() != local_ny_ || U.nghost() != nghost_ || U.batch() != components_) {
+            std::cerr << "Error: BatchField2D of size " << U.nx() << "x" << U.ny() << "x" << U.batch() << " (nghost "
+                      << U.nghost() << ") does not match the halo of size " << local_nx_ << "x" << local_ny_ << "x"
+                      << components_ << " (nghost " << nghost_ << ")" << std::endl;
+            MPI_Abort(comm_, 1);
         }
-        if(right_ != MPI_PROC_NULL && nghost_ > 0) {
-            MPI_Sendrecv(send_column_right.data(), nghost_*local_ny_, MPI_FLOAT, right_, tag_x_l2r,
-                        recv_column_right.data(), nghost_*local_ny_, MPI_FLOAT, right_, tag_x_r2l,
-                        comm_, MPI_STATUS_IGNORE);  
+    }
+
+    // Only one exchange can be in flight per HaloExchange object (the pack buffers are shared)
+    void acquire() {
+        if (in_flight_) {
+            std::cerr << "Error: HaloExchange started before the previous exchange was finished" << std::endl;
+            MPI_Abort(comm_, 1);
         }
-        if(up_ != MPI_PROC_NULL && nghost_ > 0) {
-            MPI_Sendrecv(send_row_top.data(), nghost_*local_nx_, MPI_FLOAT, up_, tag_y_b2t,
-                        recv_row_top.data(), nghost_*local_nx_, MPI_FLOAT, up_, tag_y_t2b,
-                        comm_, MPI_STATUS_IGNORE);
+        in_flight_ = true;
+    }
+
+    // Fill the messages of the selected faces exchanged with the existing neighbours of U,
+    // returns their number
+    int messages(T *U, Message msgs[4], int faces) {
+        int n = 0;
+        if (nghost_ == 0) return n;
+        const bool x = faces & faces_x, y = faces & faces_y;
+
+        if (mode_ == HaloMode::Packed) {
+            if(x && left_ != MPI_PROC_NULL) {
+                msgs[n++] = {left_, send_column_left.data(), recv_column_left.data(), nghost_*local_ny_*components_, mpi_type<T>(), tag_x_r2l, tag_x_l2r};
+            }
+            if(x && right_ != MPI_PROC_NULL) {
+                msgs[n++] = {right_, send_column_right.data(), recv_column_right.data(), nghost_*local_ny_*components_, mpi_type<T>(), tag_x_l2r, tag_x_r2l};
+            }
+            if(y && up_ != MPI_PROC_NULL) {
+                msgs[n++] = {up_, send_row_top.data(), recv_row_top.data(), nghost_*row_len_*components_, mpi_type<T>(), tag_y_b2t, tag_y_t2b};
+            }
+            if(y && down_ != MPI_PROC_NULL) {
+                msgs[n++] = {down_, send_row_bottom.data(), recv_row_bottom.data(), nghost_*row_len_*components_, mpi_type<T>(), tag_y_t2b, tag_y_b2t};
+            }
+            return n;
         }
-        if(down_ != MPI_PROC_NULL && nghost_ > 0) {
-            MPI_Sendrecv(send_row_bottom.data(), nghost_*local_nx_, MPI_FLOAT, down_, tag_y_t2b,
-                        recv_row_bottom.data(), nghost_*local_nx_, MPI_FLOAT, down_, tag_y_b2t,
-                        comm_, MPI_STATUS_IGNORE);
+
+        // Datatype mode: first value of each face of U, interior layers to send, ghost layers to receive into
+        const int c = components_;
+        int stride = (local_ny_ + 2*nghost_) * c; // Assuming row-major order
+        T *send_left = U + nghost_*stride + nghost_*c;
+        T *send_right = U + local_nx_*stride + nghost_*c;
+        T *recv_left = U + nghost_*c;
+        T *recv_right = U + (nghost_ + local_nx_)*stride + nghost_*c;
+        T *send_bottom = U + row_pad_i0_*stride + nghost_*c;
+        T *send_top = U + row_pad_i0_*stride + local_ny_*c;
+        T *recv_bottom = U + row_pad_i0_*stride;
+        T *recv_top = U + row_pad_i0_*stride + (nghost_ + local_ny_)*c;
+
+        if(x && left_ != MPI_PROC_NULL) msgs[n++] = {left_, send_left, recv_left, 1, column_type_, tag_x_r2l, tag_x_l2r};
+        if(x && right_ != MPI_PROC_NULL) msgs[n++] = {right_, send_right, recv_right, 1, column_type_, tag_x_l2r, tag_x_r2l};
+        if(y && up_ != MPI_PROC_NULL) msgs[n++] = {up_, send_top, recv_top, 1, row_type_, tag_y_b2t, tag_y_t2b};
+        if(y && down_ != MPI_PROC_NULL) msgs[n++] = {down_, send_bottom, recv_bottom, 1, row_type_, tag_y_t2b, tag_y_b2t};
+        return n;
+    }
+
+    // Record the bytes sent to each neighbour (profiling builds only)
+    static void count_bytes(const Message *msgs, int n) {
+#ifdef PDE_ENABLE_PROFILING
+        for (int k = 0; k < n; ++k) {
+            int size = 0;
+            MPI_Type_size(msgs[k].type, &size);
+            PDE_PROFILE_BYTES(msgs[k].neighbor, static_cast<long long>(size) * msgs[k].count);
         }
+#else
+        (void)msgs;
+        (void)n;
+#endif
+    }
+
+    // Copy the selected boundary layers of U into the send buffers (no-op in datatype mode).
+    // Large faces are split over the OpenMP threads.
+    void pack(const T *U, int faces) {
+        if (mode_ == HaloMode::Datatype) return;
+        PDE_PROFILE_SCOPE("halo.pack");
 
-        // Unpack received ghost layers into U
-        for(int g=0; g < nghost_; ++g) {
-            // Unpack left and right ghost layer
-            for(int j=0; j < local_ny_; ++j) {
-                if(left_ != MPI_PROC_NULL) {
-                    U[g*stride + nghost_ + j] = recv_column_left[g*local_ny_ + j]; // left ghost layer
+        // with components the x-faces are rows of local_ny * c values and every cell of the
+        // y-faces is c consecutive values
+        const int c = components_, ny = local_ny_ * c;
+        int stride = (local_ny_ + 2*nghost_) * c; // Assuming row-major order
+        // Prepare left and rigtht ghost layer to send
+        if (faces & faces_x) {
+            PDE_OMP(parallel for collapse(2) schedule(static) if(nghost_ * ny >= parallel::min_parallel))
+            for(int g=0; g < nghost_; ++g) {
+                for(int j=0; j < ny; ++j) {
+                    send_column_left[g*ny + j] = U[(nghost_+ g)*stride + nghost_*c + j]; // left ghost layer
+                    send_column_right[g*ny + j] = U[(nghost_ + local_nx_ - nghost_ + g)*stride + nghost_*c + j]; // right ghost layer
                 }
-                if(right_ != MPI_PROC_NULL) {
-                    U[(nghost_ + local_nx_ + g)*stride + nghost_ + j] = recv_column_right[g*local_ny_ + j]; // right ghost layer 
+            }
+        }
+        // Prepare top and bottom ghost layer to send
+        if (faces & faces_y) {
+            PDE_OMP(parallel for schedule(static) if(nghost_ * row_len_ * c >= parallel::min_parallel))
+            for(int i=0; i < row_len_; ++i) {
+                for(int g=0; g < nghost_; ++g) {
+                    for(int k=0; k < c; ++k) {
+                        send_row_bottom[(g*row_len_ + i)*c + k] = U[(row_pad_i0_ + i)*stride + (nghost_ + g)*c + k]; // bottom ghost layer
+                        send_row_top[(g*row_len_ + i)*c + k] = U[(row_pad_i0_ + i)*stride + (local_ny_ + g)*c + k]; // top ghost layer
+                    }
                 }
-
             }
-            // Unpack top and bottom ghost layer
-            for(int i=0; i < local_nx_; ++i) {
-                if(up_ != MPI_PROC_NULL) {
-                    U[(nghost_ + i)*stride + nghost_ + local_ny_ + g] = recv_row_top[i + g*local_nx_]; // top ghost layer
+        }
+    }
+
+    // Copy the selected received ghost layers into U (no-op in datatype mode, they were received in place)
+    void unpack(T *U, int faces) {
+        if (mode_ == HaloMode::Datatype) return;
+        PDE_PROFILE_SCOPE("halo.unpack");
+
+        const int c = components_, ny = local_ny_ * c;
+        int stride = (local_ny_ + 2*nghost_) * c; // Assuming row-major order
+        // Unpack left and right ghost layer
+        if (faces & faces_x) {
+            PDE_OMP(parallel for collapse(2) schedule(static) if(nghost_ * ny >= parallel::min_parallel))
+            for(int g=0; g < nghost_; ++g) {
+                for(int j=0; j < ny; ++j) {
+                    if(left_ != MPI_PROC_NULL) {
+                        U[g*stride + nghost_*c + j] = recv_column_left[g*ny + j]; // left ghost layer
+                    }
+                    if(right_ != MPI_PROC_NULL) {
+                        U[(nghost_ + local_nx_ + g)*stride + nghost_*c + j] = recv_column_right[g*ny + j]; // right ghost layer
+                    }
                 }
-                if(down_ != MPI_PROC_NULL) {
-                    U[(nghost_ + i)*stride +  g] = recv_row_bottom[i + g*local_nx_]; // bottom ghost layer
+            }
+        }
+        // Unpack top and bottom ghost layer
+        if (faces & faces_y) {
+            PDE_OMP(parallel for schedule(static) if(nghost_ * row_len_ * c >= parallel::min_parallel))
+            for(int i=0; i < row_len_; ++i) {
+                for(int g=0; g < nghost_; ++g) {
+                    for(int k=0; k < c; ++k) {
+                        if(up_ != MPI_PROC_NULL) {
+                            U[(row_pad_i0_ + i)*stride + (nghost_ + local_ny_ + g)*c + k] = recv_row_top[(i + g*row_len_)*c + k]; // top ghost layer
+                        }
+                        if(down_ != MPI_PROC_NULL) {
+                            U[(row_pad_i0_ + i)*stride + g*c + k] = recv_row_bottom[(i + g*row_len_)*c + k]; // bottom ghost layer
+                        }
+                    }
                 }
             }
         }
     }
 
-    
+};
+
+
+// Halo exchange of one fixed field buffer with persistent requests (MPI_Send_init/MPI_Recv_init).
+// The neighbours, counts, tags and buffers never change between iterations, so they are set up
+// once here and every swap only costs MPI_Startall + MPI_Waitall (plus pack/unpack in packed mode).
+// The buffer of U must stay alive and must not be reallocated while this object exists; note that
+// std::swap of two vectors swaps their buffers, so bind one PersistentHalo per buffer and swap
+// the PersistentHalo pointers together with the vectors.
+template <typename T>
+class PersistentHalo
+{
+    HaloExchange<T> &halo_;
+    T *U_;
+    MPI_Request requests_[8]; // requests of the x-faces first, then of the y-faces
+    int num_x_ = 0, num_y_ = 0;
 
+public:
+    PersistentHalo(HaloExchange<T> &halo, std::vector<T> &U) : halo_(halo), U_(U.data()) {
+        halo_.check_size(U);
+        init();
+    }
 
+    PersistentHalo(HaloExchange<T> &halo, Field2D<T> &U) : halo_(halo), U_(U.data()) {
+        halo_.check_size(U);
+        init();
+    }
 
+private:
+    // Create the persistent requests of the selected faces at requests_[first...], returns their number
+    int init_faces(int faces, int first) {
+        typename HaloExchange<T>::Message msgs[4];
+        int n = halo_.messages(U_, msgs, faces);
+        int count = first;
+        for(int k = 0; k < n; ++k) {
+            MPI_Recv_init(msgs[k].recv_buf, msgs[k].count, msgs[k].type, msgs[k].neighbor, msgs[k].recv_tag,
+                          halo_.comm_, &requests_[count++]);
+        }
+        for(int k = 0; k < n; ++k) {
+            MPI_Send_init(msgs[k].send_buf, msgs[k].count, msgs[k].type, msgs[k].neighbor, msgs[k].send_tag,
+                          halo_.comm_, &requests_[count++]);
+        }
+        return count - first;
+    }
+
+    void init() {
+        num_x_ = init_faces(HaloExchange<T>::faces_x, 0);
+        num_y_ = init_faces(HaloExchange<T>::faces_y, num_x_);
+    }
+
+public:
+    PersistentHalo(const PersistentHalo&) = delete;
+    PersistentHalo& operator=(const PersistentHalo&) = delete;
+
+    ~PersistentHalo() {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (finalized) return;
+        for(int k = 0; k < num_x_ + num_y_; ++k) MPI_Request_free(&requests_[k]);
+    }
+
+    // Blocking exchange: start() immediately followed by wait()
+    void exchange() {
+        start();
+        wait();
+    }
+
+    // Pack the boundary layers of the bound buffer and start the persistent requests
+    // (only those of the x-faces when the halo fills corners)
+    void start() {
+        halo_.acquire();
+        int faces = halo_.first_faces();
+        halo_.pack(U_, faces);
+        PDE_PROFILE_SCOPE("halo.post");
+        count_bytes(faces);
+        int n = halo_.corners_ ? num_x_ : num_x_ + num_y_;
+        if (n > 0) MPI_Startall(n, requests_);
+    }
+
+    // Complete the requests started by start() and unpack the ghost layers
+    void wait() {
+        int faces = halo_.first_faces();
+        int n = halo_.corners_ ? num_x_ : num_x_ + num_y_;
+        wait_requests(requests_, n);
+        halo_.unpack(U_, faces);
+        if (halo_.corners_) {
+            halo_.pack(U_, HaloExchange<T>::faces_y);
+            count_bytes(HaloExchange<T>::faces_y);
+            if (num_y_ > 0) MPI_Startall(num_y_, requests_ + num_x_);
+            wait_requests(requests_ + num_x_, num_y_);
+            halo_.unpack(U_, HaloExchange<T>::faces_y);
+        }
+        halo_.in_flight_ = false;
+    }
+
+    const T *data() const { return U_; }
+
+private:
+    static void wait_requests(MPI_Request *requests, int n) {
+        PDE_PROFILE_SCOPE("halo.wait");
+        MPI_Waitall(n, requests, MPI_STATUSES_IGNORE);
+    }
+
+    // Bytes sent by the persistent requests of the selected faces (profiling builds only)
+    void count_bytes(int faces) {
+#ifdef PDE_ENABLE_PROFILING
+        typename HaloExchange<T>::Message msgs[4];
+        int n = halo_.messages(U_, msgs, faces);
+        HaloExchange<T>::count_bytes(msgs, n);
+#else
+        (void)faces;
+#endif
+    }
 };
@@ -0,0 +1,240 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "decomp3d.hpp"
+#include "field3d.hpp"
+#include "haloExchange.hpp"
+#include "mpiTraits.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
+
+// Ghost layer exchange of Field3D<T> on a Decomp3D, the 3D counterpart of HaloExchange with
+// the same modes (HaloMode::Packed / HaloMode::Datatype) and the same split-phase begin/finish.
+//
+// Each of the (up to) six faces is described by the box of owned cells sent to the neighbour
+// and the box of ghost cells received from it. Packed mode copies these boxes into contiguous
+// buffers; datatype mode describes them once with MPI_Type_create_subarray and sends directly
+// out of / into the field.
+//
+// By default only the six faces are exchanged (enough for the 7-point stencil). With
+// corners = true the exchange runs in three phases, x-faces, then y-faces extended over the
+// x ghost layers, then z-faces extended over the x and y ghost layers, which fills the edge
+// and corner ghost cells of all 26 neighbours with messages to the 6 face neighbours only.
+template <typename T = float>
+class HaloExchange3D
+{
+    // One face: the neighbour, what is sent to it and where its data is received
+    struct Face {
+        int neighbor;
+        Box3D send, recv;
+        int send_tag, recv_tag;
+        std::vector<T> send_buf, recv_buf; // packed mode
+        MPI_Datatype send_type = MPI_DATATYPE_NULL, recv_type = MPI_DATATYPE_NULL; // datatype mode
+    };
+
+    MPI_Comm comm_;
+    int nx_, ny_, nz_, nghost_;
+    HaloMode mode_;
+    bool corners_;
+    std::vector<Face> faces_; // faces with an existing neighbour, ordered by axis
+    int axis_begin_[4] = {0, 0, 0, 0}; // faces_[axis_begin_[a], axis_begin_[a+1]) lie on axis a
+    MPI_Request requests_[12]; // in-flight requests of one phase (6 recv + 6 send)
+    int num_requests_ = 0;
+    bool in_flight_ = false;
+    static constexpr int tag_base = 20; // tag_base + 2*axis: towards plus, + 1: towards minus
+
+public:
+    HaloExchange3D(const Decomp3D &decomp, HaloMode mode = HaloMode::Packed, bool corners = false)
+        : comm_(decomp.comm()), nx_(decomp.nx()), ny_(decomp.ny()), nz_(decomp.nz()), nghost_(decomp.nghost()),
+          mode_(mode), corners_(corners)
+    {
+        // the ghost layers must come from the face neighbours
+        if (nghost_ > std::min({nx_, ny_, nz_})) {
+            std::cerr << "Error: HaloExchange3D needs nghost <= local grid size (nghost " << nghost_
+                      << ", local size " << nx_ << "x" << ny_ << "x" << nz_ << ")" << std::endl;
+            MPI_Abort(comm_, 1);
+        }
+        const int n[3] = {nx_, ny_, nz_};
+        const int minus[3] = {decomp.left(), decomp.down(), decomp.back()};
+        const int plus[3] = {decomp.right(), decomp.up(), decomp.front()};
+        faces_.reserve(6);
+        for (int a = 0; a < 3; ++a) {
+            axis_begin_[a] = static_cast<int>(faces_.size());
+            if (nghost_ == 0) continue;
+            // the transverse extent, over the ghost layers of the axes exchanged before with corners
+            Box3D base{0, nx_, 0, ny_, 0, nz_};
+            for (int b = 0; corners_ && b < a; ++b) set_range(base, b, -nghost_, n[b] + nghost_);
+            for (int side = 0; side < 2; ++side) {
+                int neighbor = side ? plus[a] : minus[a];
+                if (neighbor == MPI_PROC_NULL) continue;
+                Face face;
+                face.neighbor = neighbor;
+                face.send = face.recv = base;
+                if (side) {
+                    set_range(face.send, a, n[a] - nghost_, n[a]);
+                    set_range(face.recv, a, n[a], n[a] + nghost_);
+                    face.send_tag = tag_base + 2*a;
+                    face.recv_tag = tag_base + 2*a + 1;
+                }
+                else {
+                    set_range(face.send, a, 0, nghost_);
+                    set_range(face.recv, a, -nghost_, 0);
+                    face.send_tag = tag_base + 2*a + 1;
+                    face.recv_tag = tag_base + 2*a;
+                }
+                if (mode_ == HaloMode::Packed) {
+                    face.send_buf.resize(face.send.count());
+                    face.recv_buf.resize(face.recv.count());
+                }
+                else {
+                    face.send_type = subarray(face.send);
+                    face.recv_type = subarray(face.recv);
+                }
+                faces_.push_back(std::move(face));
+            }
+        }
+        axis_begin_[3] = static_cast<int>(faces_.size());
+    }
+
+    // The committed datatypes and in-flight requests are owned by this object
+    HaloExchange3D(const HaloExchange3D&) = delete;
+    HaloExchange3D& operator=(const HaloExchange3D&) = delete;
+
+    ~HaloExchange3D() {
+        // the object may outlive MPI_Finalize when declared in main, types are gone by then
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (finalized) return;
+        for (Face &face : faces_) {
+            if (face.send_type != MPI_DATATYPE_NULL) MPI_Type_free(&face.send_type);
+            if (face.recv_type != MPI_DATATYPE_NULL) MPI_Type_free(&face.recv_type);
+        }
+    }
+
+    HaloMode mode() const { return mode_; }
+    bool corners() const { return corners_; }
+
+    // Blocking exchange: begin() immediately followed by finish()
+    void exchange(Field3D<T> &U) {
+        PDE_PROFILE_SCOPE("halo.exchange");
+        begin(U);
+        finish(U);
+    }
+
+    // Split-phase exchange, first half: pack the boundary layers of U and post non-blocking
+    // receives and sends (of the x-faces only with corners). Until finish() is called U must
+    // not be modified, but its interior can be read.
+    void begin(Field3D<T> &U) {
+        check_size(U);
+        if (in_flight_) {
+            std::cerr << "Error: HaloExchange3D started before the previous exchange was finished" << std::endl;
+            MPI_Abort(comm_, 1);
+        }
+        in_flight_ = true;
+        post(U, 0, corners_ ? 1 : 3);
+    }
+
+    // Split-phase exchange, second half: wait for the messages posted by begin(), unpack them
+    // and, with corners, run the y- and z-phases. U must be the field passed to begin().
+    void finish(Field3D<T> &U) {
+        complete(U, 0, corners_ ? 1 : 3);
+        if (corners_) {
+            for (int a = 1; a < 3; ++a) {
+                post(U, a, a + 1);
+                complete(U, a, a + 1);
+            }
+        }
+        in_flight_ = false;
+    }
+
+private:
+    static void set_range(Box3D &box, int axis, int begin, int end) {
+        if (axis == 0) { box.i_begin = begin; box.i_end = end; }
+        else if (axis == 1) { box.j_begin = begin; box.j_end = end; }
+        else { box.k_begin = begin; box.k_end = end; }
+    }
+
+    // Datatype selecting the box out of a padded field (indices shifted by nghost)
+    MPI_Datatype subarray(const Box3D &box) const {
+        int sizes[3] = {nx_ + 2*nghost_, ny_ + 2*nghost_, nz_ + 2*nghost_};
+        int subsizes[3] = {box.i_end - box.i_begin, box.j_end - box.j_begin, box.k_end - box.k_begin};
+        int starts[3] = {box.i_begin + nghost_, box.j_begin + nghost_, box.k_begin + nghost_};
+        MPI_Datatype type;
+        MPI_Type_create_subarray(3, sizes, subsizes, starts, MPI_ORDER_C, mpi_type<T>(), &type);
+        MPI_Type_commit(&type);
+        return type;
+    }
+
+    // Pack the faces of axes [a_begin, a_end) and post their receives and sends
+    void post(Field3D<T> &U, int a_begin, int a_end) {
+        const int f_begin = axis_begin_[a_begin], f_end = axis_begin_[a_end];
+        if (mode_ == HaloMode::Packed) {
+            PDE_PROFILE_SCOPE("halo.pack");
+            for (int f = f_begin; f < f_end; ++f) copy_box(U, faces_[f].send, faces_[f].send_buf.data(), true);
+        }
+        PDE_PROFILE_SCOPE("halo.post");
+        // Post the receives before the sends so incoming messages can land directly in the recv buffers
+        for (int f = f_begin; f < f_end; ++f) {
+            Face &face = faces_[f];
+            if (mode_ == HaloMode::Packed) {
+                MPI_Irecv(face.recv_buf.data(), static_cast<int>(face.recv_buf.size()), mpi_type<T>(), face.neighbor,
+                          face.recv_tag, comm_, &requests_[num_requests_++]);
+            }
+            else {
+                MPI_Irecv(U.data(), 1, face.recv_type, face.neighbor, face.recv_tag, comm_, &requests_[num_requests_++]);
+            }
+        }
+        for (int f = f_begin; f < f_end; ++f) {
+            Face &face = faces_[f];
+            if (mode_ == HaloMode::Packed) {
+                MPI_Isend(face.send_buf.data(), static_cast<int>(face.send_buf.size()), mpi_type<T>(), face.neighbor,
+                          face.send_tag, comm_, &requests_[num_requests_++]);
+            }
+            else {
+                MPI_Isend(U.data(), 1, face.send_type, face.neighbor, face.send_tag, comm_, &requests_[num_requests_++]);
+            }
+            PDE_PROFILE_BYTES(face.neighbor, face.send.count() * static_cast<long long>(sizeof(T)));
+        }
+    }
+
+    // Wait for the posted messages and unpack the faces of axes [a_begin, a_end) into U
+    void complete(Field3D<T> &U, int a_begin, int a_end) {
+        {
+            PDE_PROFILE_SCOPE("halo.wait");
+            MPI_Waitall(num_requests_, requests_, MPI_STATUSES_IGNORE);
+        }
+        num_requests_ = 0;
+        if (mode_ == HaloMode::Datatype) return; // received in place
+        PDE_PROFILE_SCOPE("halo.unpack");
+        for (int f = axis_begin_[a_begin]; f < axis_begin_[a_end]; ++f) {
+            copy_box(U, faces_[f].recv, faces_[f].recv_buf.data(), false);
+        }
+    }
+
+    // Copy a box of U into buf (pack) or buf into the box of U (unpack), z-rows at a time.
+    // Large boxes are split over the OpenMP threads.
+    static void copy_box(Field3D<T> &U, const Box3D &box, T *buf, bool pack) {
+        const int nj = box.j_end - box.j_begin, nk = box.k_end - box.k_begin;
+        PDE_OMP(parallel for collapse(2) schedule(static) if(box.count() >= parallel::min_parallel))
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            for (int j = box.j_begin; j < box.j_end; ++j) {
+                T *b = buf + (static_cast<std::size_t>(i - box.i_begin) * nj + (j - box.j_begin)) * nk;
+                T *u = U.row(i, j, box.k_begin);
+                if (pack) std::copy(u, u + nk, b);
+                else std::copy(b, b + nk, u);
+            }
+        }
+    }
+
+    void check_size(const Field3D<T> &U) const {
+        if (U.nx() != nx_ || U.ny() != ny_ || U.nz() != nz_ || U.nghost() != nghost_) {
+            std::cerr << "Error: Field3D of size " << U.nx() << "x" << U.ny() << "x" << U.nz() << " (nghost " << U.nghost()
+                      << ") does not match the halo of size " << nx_ << "x" << ny_ << "x" << nz_
+                      << " (nghost " << nghost_ << ")" << std::endl;
+            MPI_Abort(comm_, 1);
+        }
+    }
+};
@@ -0,0 +1,10 @@
+#pragma once
+#include <mpi.h>
+
+// MPI datatype matching a C++ scalar type, e.g. mpi_type<float>() == MPI_FLOAT
+template <typename T> inline MPI_Datatype mpi_type();
+
+template <> inline MPI_Datatype mpi_type<float>() { return MPI_FLOAT; }
+template <> inline MPI_Datatype mpi_type<double>() { return MPI_DOUBLE; }
+template <> inline MPI_Datatype mpi_type<int>() { return MPI_INT; }
+template <> inline MPI_Datatype mpi_type<long long>() { return MPI_LONG_LONG; }
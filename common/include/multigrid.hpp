@@ -0,0 +1,336 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "cg.hpp"
+#include "chebyshev.hpp"
+#include "decomp2d.hpp"
+#include "field2d.hpp"
+#include "fieldOps.hpp"
+#include "haloExchange.hpp"
+#include "mpiTraits.hpp"
+#include "parallel.hpp"
+#include "poisson2d.hpp"
+#include "profiler.hpp"
+#include "solver.hpp"
+
+
+enum class MGCycle { V, W, F };
+enum class MGSmoother { Jacobi, RedBlack, Chebyshev };
+
+// Parallel geometric multigrid for A = Poisson2D, usable as a solver (solve) and as a
+// preconditioner for CG (apply, one cycle from a zero initial guess).
+//
+// Levels are vertex-centred: a grid of N points coarsens to (N - 1) / 2 + 1 points by keeping
+// every even point, as long as N - 1 is even and the coarse grid has interior points (along a
+// periodic axis N must be even and coarsens to N / 2 points). Each coarse level is partitioned
+// with the splits of the finer one halved, so restriction and prolongation only need one ghost
+// layer (with corners) and no data moves between ranks. Once some rank would
+// own fewer than min_local coarse points in x or y, the coarse problem is gathered onto every
+// rank and the remaining levels run redundantly on MPI_COMM_SELF; the coarsest level is solved
+// with CG.
+//
+// Smoother: weighted Jacobi, red-black Gauss-Seidel (in place, half the halo traffic per
+// sweep, and a stronger smoother) or Chebyshev (the sweeps are the polynomial degree, tuned to
+// the upper part of the spectrum of each level, estimated there on first use). Transfers: full weighting restriction and bilinear prolongation.
+// V- and W-cycles with pre_smooth == post_smooth are symmetric, as CG requires of a preconditioner
+// (red-black post-smoothing runs the colours in reverse order for that).
+template <typename T>
+class Multigrid : public Preconditioner<T>
+{
+    struct Level {
+        Poisson2D<T> A;
+        HaloExchange<T> transfer; // fills corners, for restriction and prolongation
+        Field2D<T> u, f, r, t; // solution (correction), right-hand side, residual, smoother work array
+        std::unique_ptr<Chebyshev<T>> chebyshev; // set up by the first Chebyshev smoothing
+
+        Level(const Decomp2D &decomp, T hx, T hy)
+            : A(decomp, hx, hy), transfer(decomp, HaloMode::Packed, true),
+              u(decomp), f(decomp), r(decomp), t(decomp) {}
+    };
+
+    std::vector<std::unique_ptr<Level>> levels_;
+    std::unique_ptr<CGSolver<T>> coarse_solver_;
+
+    // Agglomeration below level agglomerate_ (-1: all levels are distributed)
+    int agglomerate_ = -1;
+    std::vector<int> cx_splits_, cy_splits_; // distributed partition of the gathered coarse grid
+    std::unique_ptr<Field2D<T>> block_; // this rank's part of the gathered coarse right-hand side
+    std::vector<int> counts_, displs_;
+    std::vector<T> gathered_;
+
+public:
+    MGCycle cycle_type = MGCycle::V;
+    int pre_smooth = 2;
+    int post_smooth = 2;
+    MGSmoother smoother = MGSmoother::Jacobi;
+    T omega = T(0.8); // Jacobi weight, 4/5 damps the high frequencies of the 5-point Laplacian best
+    double chebyshev_ratio = 4.0; // Chebyshev smoothing targets [upper / ratio, upper], the modes coarsening cannot represent
+    int max_iter = 50; // cycles of solve()
+    double rtol = 1e-8; // solve() stops when ||r|| <= rtol * ||b||
+    int check_interval = 1; // solve() computes the residual norm only every check_interval cycles
+    int verbose = 0; // rank 0 prints the residual every `verbose` cycles of solve() (0: silent)
+
+    explicit Multigrid(const Poisson2D<T> &A, int min_local = 4) {
+        min_local = std::max(min_local, 1);
+        Decomp2D decomp = A.decomp();
+        T hx = A.hx(), hy = A.hy();
+        levels_.push_back(std::make_unique<Level>(decomp, hx, hy));
+
+        while (coarsenable(decomp)) {
+            std::vector<int> cx = coarse_splits(decomp.x_splits());
+            std::vector<int> cy = coarse_splits(decomp.y_splits());
+            hx *= T(2);
+            hy *= T(2);
+            if (agglomerate_ < 0 && decomp.size() > 1 && min_width(cx, cy) < min_local) {
+                agglomerate_ = static_cast<int>(levels_.size()) - 1;
+                setup_agglomeration(decomp, cx, cy);
+                decomp = Decomp2D(MPI_COMM_SELF, cx.back(), cy.back(), 1, 1, 1, decomp.periodic_x(), decomp.periodic_y());
+            }
+            else {
+                decomp = Decomp2D(decomp.comm(), cx, cy, 1, decomp.periodic_x(), decomp.periodic_y());
+            }
+            levels_.push_back(std::make_unique<Level>(decomp, hx, hy));
+        }
+
+        coarse_solver_ = std::make_unique<CGSolver<T>>(levels_.back()->A);
+        coarse_solver_->rtol = 1e3 * std::numeric_limits<T>::epsilon();
+        coarse_solver_->max_iter = 1000;
+    }
+
+    int num_levels() const { return static_cast<int>(levels_.size()); }
+    // Finest level whose coarse grid is gathered onto every rank (-1: none)
+    int agglomeration_level() const { return agglomerate_; }
+    const Decomp2D &level_decomp(int l) const { return levels_[l]->A.decomp(); }
+
+    // z = one cycle applied to r from a zero initial guess
+    void apply(const Field2D<T> &r, Field2D<T> &z) override {
+        Level &L = *levels_[0];
+        const Box &box = L.A.box();
+        fieldops::copy(r, L.f, box);
+        fieldops::set(L.u, T(0), box);
+        cycle(0, cycle_type);
+        // constants are invisible to a singular A but would make CG's search directions degenerate
+        if (L.A.decomp().periodic_x() && L.A.decomp().periodic_y()) remove_mean(L.u, L.A);
+        fieldops::copy(L.u, z, box);
+    }
+
+    // Solve A x = b by repeated cycles, x holds the initial guess on entry
+    SolveStats solve(const Field2D<T> &b, Field2D<T> &x) {
+        Level &L = *levels_[0];
+        const Box &box = L.A.box();
+        MPI_Comm comm = L.A.comm();
+        SolveStats stats;
+
+        double norm_b = fieldops::norm2(b, box, comm);
+        if (norm_b == 0.0) {
+            fieldops::set(x, T(0), box);
+            stats.converged = true;
+            return stats;
+        }
+
+        fieldops::copy(b, L.f, box);
+        fieldops::copy(x, L.u, box);
+        const int interval = std::max(check_interval, 1);
+        for (int iter = 0; ; ++iter) {
+            // the last cycle always gets a check so the returned residual is current
+            const bool check = iter % interval == 0 || iter == max_iter;
+            if (check) {
+                L.A.residual(L.u, L.f, L.r);
+                stats.residual = fieldops::norm2(L.r, box, comm) / norm_b;
+                if (stats.residual <= rtol) {
+                    stats.converged = true;
+                    break;
+                }
+            }
+            if (iter == max_iter) break;
+            if (check && verbose > 0 && iter % verbose == 0 && L.A.decomp().rank() == 0) {
+                std::printf("MG cycle %d: relative residual = %e\n", iter, stats.residual);
+            }
+            cycle(0, cycle_type);
+            stats.iterations = iter + 1;
+        }
+        fieldops::copy(L.u, x, box);
+        return stats;
+    }
+
+private:
+    static bool coarsenable(int N, bool periodic) {
+        return periodic ? (N >= 4 && N % 2 == 0) : (N >= 5 && (N - 1) % 2 == 0);
+    }
+
+    static bool coarsenable(const Decomp2D &d) {
+        return coarsenable(d.Nx(), d.periodic_x()) && coarsenable(d.Ny(), d.periodic_y());
+    }
+
+    // A rank owning fine points [s, e) owns the coarse points I with 2I in [s, e)
+    static std::vector<int> coarse_splits(const std::vector<int> &splits) {
+        std::vector<int> coarse(splits.size());
+        for (std::size_t k = 0; k < splits.size(); ++k) coarse[k] = (splits[k] + 1) / 2;
+        return coarse;
+    }
+
+    static int min_width(const std::vector<int> &cx, const std::vector<int> &cy) {
+        int w = cx.back();
+        for (std::size_t k = 1; k < cx.size(); ++k) w = std::min(w, cx[k] - cx[k - 1]);
+        for (std::size_t k = 1; k < cy.size(); ++k) w = std::min(w, cy[k] - cy[k - 1]);
+        return w;
+    }
+
+    // Blocks of the coarse grid of fine decomposition d, as they would be partitioned by cx x cy
+    void setup_agglomeration(const Decomp2D &d, const std::vector<int> &cx, const std::vector<int> &cy) {
+        cx_splits_ = cx;
+        cy_splits_ = cy;
+        block_ = std::make_unique<Field2D<T>>(cx[d.px() + 1] - cx[d.px()], cy[d.py() + 1] - cy[d.py()], 0,
+                                              cx[d.px()], cy[d.py()]);
+        counts_.resize(d.size());
+        displs_.resize(d.size());
+        int offset = 0;
+        for (int r = 0; r < d.size(); ++r) {
+            int px = r % d.Px(), py = r / d.Px();
+            counts_[r] = (cx[px + 1] - cx[px]) * (cy[py + 1] - cy[py]);
+            displs_[r] = offset;
+            offset += counts_[r];
+        }
+        gathered_.resize(offset);
+    }
+
+    void cycle(int l, MGCycle type) {
+        Level &L = *levels_[l];
+        if (l + 1 == num_levels()) {
+            PDE_PROFILE_SCOPE("mg.coarse_solve");
+            fieldops::set(L.u, T(0), L.A.box());
+            if (L.A.decomp().periodic_x() && L.A.decomp().periodic_y()) remove_mean(L.f, L.A);
+            coarse_solver_->solve(L.f, L.u);
+            return;
+        }
+        Level &C = *levels_[l + 1];
+
+        smooth(L, pre_smooth, false);
+        L.A.residual(L.u, L.f, L.r);
+        restrict_residual(l);
+
+        fieldops::set(C.u, T(0), C.A.box());
+        cycle(l + 1, type);
+        if (type == MGCycle::W) cycle(l + 1, MGCycle::W);
+        else if (type == MGCycle::F) cycle(l + 1, MGCycle::V);
+
+        // fine points next to a rank boundary (or a periodic edge) interpolate from coarse ghosts
+        {
+            PDE_PROFILE_SCOPE("mg.prolongate");
+            C.transfer.exchange(C.u);
+            prolongate_add(C.u, L.u, L.A.box());
+        }
+        smooth(L, post_smooth, true);
+    }
+
+    // A is singular when both axes are periodic: remove the constant component of a field (a
+    // right-hand side projected onto the range of A, or a correction without null space part)
+    static void remove_mean(Field2D<T> &f, const Poisson2D<T> &A) {
+        const Box &box = A.box();
+        double sums[2] = {0.0, static_cast<double>(box.count())};
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            for (int j = box.j_begin; j < box.j_end; ++j) sums[0] += f(i, j);
+        }
+        MPI_Allreduce(MPI_IN_PLACE, sums, 2, MPI_DOUBLE, MPI_SUM, A.comm());
+        T mean = static_cast<T>(sums[0] / sums[1]);
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            for (int j = box.j_begin; j < box.j_end; ++j) f(i, j) -= mean;
+        }
+    }
+
+    void smooth(Level &L, int sweeps, bool post) {
+        PDE_PROFILE_SCOPE("mg.smooth");
+        // a periodic axis of odd length cannot be coloured consistently, Jacobi there
+        if (smoother == MGSmoother::RedBlack && L.A.red_black()) {
+            for (int k = 0; k < sweeps; ++k) L.A.sor(L.u, L.f, T(1), post);
+            return;
+        }
+        if (smoother == MGSmoother::Chebyshev) {
+            if (!L.chebyshev) {
+                L.chebyshev = std::make_unique<Chebyshev<T>>(L.A);
+                L.chebyshev->set_interval(L.chebyshev->upper() / chebyshev_ratio, L.chebyshev->upper());
+            }
+            L.chebyshev->smooth(L.f, L.u, sweeps);
+            return;
+        }
+        for (int k = 0; k < sweeps; ++k) {
+            L.A.jacobi(L.u, L.f, L.t, omega);
+            std::swap(L.u, L.t);
+        }
+    }
+
+    // f of level l + 1 = full weighting of the residual of level l
+    void restrict_residual(int l) {
+        PDE_PROFILE_SCOPE("mg.restrict");
+        Level &L = *levels_[l];
+        Level &C = *levels_[l + 1];
+        L.transfer.exchange(L.r);
+        if (l != agglomerate_) {
+            full_weighting(L.r, C.f, C.A.decomp());
+            return;
+        }
+
+        // restrict into this rank's block and gather all blocks onto every rank
+        full_weighting(L.r, *block_, C.A.decomp());
+        MPI_Allgatherv(block_->data(), block_->nx() * block_->ny(), mpi_type<T>(), gathered_.data(),
+                       counts_.data(), displs_.data(), mpi_type<T>(), L.A.comm());
+        int Px = static_cast<int>(cx_splits_.size()) - 1;
+        for (std::size_t r = 0; r < counts_.size(); ++r) {
+            int px = static_cast<int>(r) % Px, py = static_cast<int>(r) / Px;
+            int width = cy_splits_[py + 1] - cy_splits_[py];
+            const T *src = gathered_.data() + displs_[r];
+            for (int i = cx_splits_[px]; i < cx_splits_[px + 1]; ++i, src += width) {
+                std::copy(src, src + width, C.f.row(C.f.local_i(i), C.f.local_j(cy_splits_[py])));
+            }
+        }
+    }
+
+    // fc(I, J) = 1/16 [4 r(2I, 2J) + 2 (edge neighbours) + (corner neighbours)] for the coarse
+    // unknowns owned by fc on the coarse grid of decomposition dc; r needs its ghost corners
+    static void full_weighting(const Field2D<T> &r, Field2D<T> &fc, const Decomp2D &dc) {
+        int I0 = fc.i0(), I1 = fc.i0() + fc.nx();
+        int J0 = fc.j0(), J1 = fc.j0() + fc.ny();
+        if (!dc.periodic_x()) {
+            I0 = std::max(1, I0);
+            I1 = std::min(dc.Nx() - 1, I1);
+        }
+        if (!dc.periodic_y()) {
+            J0 = std::max(1, J0);
+            J1 = std::min(dc.Ny() - 1, J1);
+        }
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(I1 - I0) * (J1 - J0) >= parallel::min_parallel))
+        for (int I = I0; I < I1; ++I) {
+            int i = r.local_i(2 * I);
+            const T *rm = r.row(i - 1), *r0 = r.row(i), *rp = r.row(i + 1);
+            T *out = fc.row(fc.local_i(I));
+            for (int J = J0; J < J1; ++J) {
+                int j = r.local_j(2 * J);
+                out[fc.local_j(J)] = T(0.0625) * (T(4) * r0[j]
+                                                  + T(2) * (rm[j] + rp[j] + r0[j - 1] + r0[j + 1])
+                                                  + rm[j - 1] + rm[j + 1] + rp[j - 1] + rp[j + 1]);
+            }
+        }
+    }
+
+    // u += bilinear interpolation of the coarse correction c over box (local indices of u); c must
+    // hold the coarse points around every fine point of the box, ghost corners included
+    static void prolongate_add(const Field2D<T> &c, Field2D<T> &u, const Box &box) {
+        PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            int gi = u.global_i(i);
+            // even points coincide with a coarse point, odd ones average their two coarse neighbours
+            const T *c0 = c.row(c.local_i(gi / 2)), *c1 = c.row(c.local_i((gi + 1) / 2));
+            T *pu = u.row(i);
+            for (int j = box.j_begin; j < box.j_end; ++j) {
+                int gj = u.global_j(j);
+                int j0 = c.local_j(gj / 2), j1 = c.local_j((gj + 1) / 2);
+                pu[j] += T(0.25) * (c0[j0] + c0[j1] + c1[j0] + c1[j1]);
+            }
+        }
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <mpi.h>
+#include <cstdio>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// Threading within one MPI rank (hybrid MPI + OpenMP mode).
+//
+// PDE_OMP(directive) expands to `#pragma omp directive` when compiled with OpenMP and to
+// nothing otherwise, so builds without OpenMP neither need it nor warn about unknown pragmas.
+// All MPI calls stay outside parallel regions (MPI_THREAD_FUNNELED is enough).
+#ifdef _OPENMP
+#define PDE_PRAGMA(x) _Pragma(#x)
+#define PDE_OMP(directive) PDE_PRAGMA(omp directive)
+#else
+#define PDE_OMP(directive)
+#endif
+
+namespace parallel
+{
+
+// Loops over fewer values than this run on one thread, forking would cost more than the work
+constexpr long long min_parallel = 16384;
+
+// Number of threads a parallel region of this rank uses
+inline int max_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// MPI_Init for the hybrid mode. OpenMP threads only compute between MPI calls, which stay on
+// the main thread, so MPI_THREAD_FUNNELED is requested. An MPI library that provides less may
+// not tolerate other threads at all: rank 0 warns and the ranks run single-threaded.
+inline void init_mpi(int *argc, char ***argv) {
+    int provided = MPI_THREAD_SINGLE;
+    MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+    if (provided >= MPI_THREAD_FUNNELED) return;
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0 && max_threads() > 1) {
+        std::fprintf(stderr, "Warning: the MPI library does not provide MPI_THREAD_FUNNELED, running with 1 OpenMP thread per rank\n");
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+}
+
+} // namespace parallel
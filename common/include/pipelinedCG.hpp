@@ -0,0 +1,189 @@
+#pragma once
+#include <mpi.h>
+#include <cmath>
+#include <cstdio>
+#include "field2d.hpp"
+#include "fieldOps.hpp"
+#include "parallel.hpp"
+#include "poisson2d.hpp"
+#include "profiler.hpp"
+#include "solver.hpp"
+
+
+// Pipelined preconditioned CG (Ghysels and Vanroose) for A x = b with A = Poisson2D, a drop-in
+// replacement for CGSolver at high rank counts. CGSolver waits for two reductions per
+// iteration; here the three dot products of an iteration, <r, u>, <w, u> and <r, r>, travel in
+// one MPI_Iallreduce that is overlapped with the preconditioner application m = M w and the
+// matrix-vector product n = A m (including its halo exchange). The price is more vector updates
+// (four auxiliary recurrences: w = A u, s = A p, q = M s, z = A q) and a recursively updated
+// residual that drifts further from the true one in rounding, until the recurrences stagnate
+// or break down above the accuracy CG attains. Every replace_interval iterations the recursive
+// vectors are therefore recomputed from x and p (residual replacement, three matrix-vector
+// products and two preconditioner applications), which keeps the iteration count of CG. The
+// vector updates and the local dot products are each fused into one pass over the fields.
+// Convergence of the recursive residual is confirmed with the true one; if that is still too
+// large, or the step length turns non-positive, CG restarts from the current x. The residual
+// reported is the true one.
+template <typename T>
+class PipelinedCGSolver
+{
+    Poisson2D<T> &A_;
+    Preconditioner<T> *M_;
+    Field2D<T> r_, u_, w_, m_, n_, p_, s_, q_, z_;
+
+public:
+    int max_iter = 10000;
+    double rtol = 1e-8; // stop when ||r|| <= rtol * ||b||
+    int verbose = 0; // rank 0 prints the residual every `verbose` iterations (0: silent)
+    int replace_interval = 100; // iterations between residual replacements (0: never)
+
+    PipelinedCGSolver(Poisson2D<T> &A, Preconditioner<T> *M = nullptr)
+        : A_(A), M_(M), r_(A.decomp()), u_(A.decomp()), w_(A.decomp()), m_(A.decomp()), n_(A.decomp()),
+          p_(A.decomp()), s_(A.decomp()), q_(A.decomp()), z_(A.decomp()) {}
+
+    // Solve A x = b, x holds the initial guess on entry
+    SolveStats solve(const Field2D<T> &b, Field2D<T> &x) {
+        const Box &box = A_.box();
+        MPI_Comm comm = A_.comm();
+        SolveStats stats;
+
+        double norm_b = fieldops::norm2(b, box, comm);
+        if (norm_b == 0.0) {
+            fieldops::set(x, T(0), box);
+            stats.converged = true;
+            return stats;
+        }
+
+        A_.residual(x, b, r_);
+        restart();
+        bool first = true; // first step after a (re)start: beta = 0
+        double gamma_old = 0.0, alpha_old = 0.0;
+        for (int iter = 0; ; ++iter) {
+            double sums[3];
+            local_dots(sums);
+            MPI_Request request;
+            MPI_Iallreduce(MPI_IN_PLACE, sums, 3, MPI_DOUBLE, MPI_SUM, comm, &request);
+
+            // overlapped with the reduction: m = M w, n = A m (skipped once the iterations are done)
+            const bool last = iter == max_iter;
+            if (!last) {
+                precondition(w_, m_);
+                A_.apply(m_, n_);
+            }
+            {
+                PDE_PROFILE_SCOPE("pipecg.wait");
+                MPI_Wait(&request, MPI_STATUS_IGNORE);
+            }
+            const double gamma = sums[0], delta = sums[1];
+            stats.residual = std::sqrt(sums[2]) / norm_b;
+            if (stats.residual <= rtol || last) {
+                A_.residual(x, b, r_);
+                stats.residual = fieldops::norm2(r_, box, comm) / norm_b;
+                stats.converged = stats.residual <= rtol;
+                if (stats.converged || last) break;
+                restart();
+                first = true;
+                continue;
+            }
+            if (verbose > 0 && iter % verbose == 0 && A_.decomp().rank() == 0) {
+                std::printf("Pipelined CG iteration %d: relative residual = %e\n", iter, stats.residual);
+            }
+
+            double alpha, beta;
+            if (first) {
+                beta = 0.0;
+                alpha = gamma / delta;
+            }
+            else {
+                beta = gamma / gamma_old;
+                alpha = gamma / (delta - beta * gamma / alpha_old);
+            }
+            if (!(alpha > 0.0) || !std::isfinite(alpha)) {
+                if (first) break; // breakdown right after a restart (e.g. singular periodic A)
+                A_.residual(x, b, r_);
+                restart();
+                first = true;
+                continue;
+            }
+            first = false;
+            gamma_old = gamma;
+            alpha_old = alpha;
+
+            update(static_cast<T>(alpha), static_cast<T>(beta), x);
+            stats.iterations = iter + 1;
+
+            if (replace_interval > 0 && stats.iterations % replace_interval == 0) {
+                A_.residual(x, b, r_);
+                replace();
+            }
+        }
+        return stats;
+    }
+
+private:
+    // <r, u>, <w, u>, <r, r> over the unknowns of this rank
+    void local_dots(double *sums) const {
+        const Box &box = A_.box();
+        double ru = 0.0, wu = 0.0, rr = 0.0;
+        PDE_OMP(parallel for schedule(static) reduction(+:ru, wu, rr) if(box.count() >= parallel::min_parallel))
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            const T *pr = r_.row(i), *pu = u_.row(i), *pw = w_.row(i);
+            for (int j = box.j_begin; j < box.j_end; ++j) {
+                ru += static_cast<double>(pr[j]) * pu[j];
+                wu += static_cast<double>(pw[j]) * pu[j];
+                rr += static_cast<double>(pr[j]) * pr[j];
+            }
+        }
+        sums[0] = ru;
+        sums[1] = wu;
+        sums[2] = rr;
+    }
+
+    // z = n + beta z, q = m + beta q, s = w + beta s, p = u + beta p,
+    // x += alpha p, r -= alpha s, u -= alpha q, w -= alpha z
+    void update(T alpha, T beta, Field2D<T> &x) {
+        PDE_PROFILE_SCOPE("pipecg.update");
+        const Box &box = A_.box();
+        PDE_OMP(parallel for schedule(static) if(box.count() >= parallel::min_parallel))
+        for (int i = box.i_begin; i < box.i_end; ++i) {
+            const T *pn = n_.row(i), *pm = m_.row(i);
+            T *pz = z_.row(i), *pq = q_.row(i), *ps = s_.row(i), *pp = p_.row(i);
+            T *px = x.row(i), *pr = r_.row(i), *pu = u_.row(i), *pw = w_.row(i);
+            for (int j = box.j_begin; j < box.j_end; ++j) {
+                pz[j] = pn[j] + beta * pz[j];
+                pq[j] = pm[j] + beta * pq[j];
+                ps[j] = pw[j] + beta * ps[j];
+                pp[j] = pu[j] + beta * pp[j];
+                px[j] += alpha * pp[j];
+                pr[j] -= alpha * ps[j];
+                pu[j] -= alpha * pq[j];
+                pw[j] -= alpha * pz[j];
+            }
+        }
+    }
+
+    // Residual replacement with r = b - A x already computed: u = M r, w = A u, s = A p,
+    // q = M s, z = A q
+    void replace() {
+        PDE_PROFILE_SCOPE("pipecg.replace");
+        precondition(r_, u_);
+        A_.apply(u_, w_);
+        A_.apply(p_, s_);
+        precondition(s_, q_);
+        A_.apply(q_, z_);
+    }
+
+    // Restart with r = b - A x already computed: u = M r, w = A u (p, s, q and z are reset by
+    // the first step, with beta = 0)
+    void restart() {
+        PDE_PROFILE_SCOPE("pipecg.restart");
+        precondition(r_, u_);
+        A_.apply(u_, w_);
+    }
+
+    void precondition(const Field2D<T> &r, Field2D<T> &z) {
+        PDE_PROFILE_SCOPE("cg.precondition");
+        if (M_) M_->apply(r, z);
+        else fieldops::copy(r, z, A_.box());
+    }
+};
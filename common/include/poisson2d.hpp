@@ -0,0 +1,115 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include "decomp2d.hpp"
+#include "field2d.hpp"
+#include "haloExchange.hpp"
+#include "profiler.hpp"
+#include "stencil.hpp"
+
+
+// Matrix-free 5-point operator A = -Laplacian on the grid of a Decomp2D with homogeneous
+// Dirichlet boundary values. The unknowns are the cells off the global boundary
+// (stencil::dirichlet_box); fields handed to the operator are expected to be zero on the
+// boundary cells, which makes A symmetric positive definite on the unknowns. Along a periodic
+// axis of the decomposition every cell is an unknown; with both axes periodic A is only
+// semi-definite (constants are in its null space) and right-hand sides need a zero mean.
+//
+// apply(), residual(), jacobi() and sor() exchange the halo of their input and overlap the exchange
+// with the part of the stencil that does not read ghost cells.
+template <typename T>
+class Poisson2D
+{
+    Decomp2D decomp_;
+    HaloExchange<T> halo_;
+    T hx_, hy_;
+    T inv_hx2_, inv_hy2_;
+    Box box_; // unknowns owned by this rank
+    Box inner_; // unknowns whose stencil does not reach into the ghost layers
+    Box strips_[4];
+    int num_strips_;
+
+public:
+    Poisson2D(const Decomp2D &decomp, T hx, T hy, HaloMode mode = HaloMode::Packed)
+        : decomp_(decomp), halo_(decomp, mode), hx_(hx), hy_(hy), inv_hx2_(T(1) / (hx * hx)), inv_hy2_(T(1) / (hy * hy))
+    {
+        if (decomp.nghost() < 1) {
+            if (decomp.rank() == 0) {
+                std::cerr << "Error: Poisson2D needs a decomposition with nghost >= 1" << std::endl;
+            }
+            MPI_Abort(decomp.comm(), 1);
+        }
+        box_ = stencil::dirichlet_box(decomp);
+        inner_ = box_.intersect(Box{1, decomp.nx() - 1, 1, decomp.ny() - 1});
+        num_strips_ = box_.subtract(inner_, strips_);
+    }
+
+    // y = A x on the unknowns (updates the ghost layers of x)
+    void apply(Field2D<T> &x, Field2D<T> &y) {
+        PDE_PROFILE_SCOPE("poisson.apply");
+        halo_.begin(x);
+        stencil::laplacian(x, y, inner_, inv_hx2_, inv_hy2_);
+        halo_.finish(x);
+        for (int s = 0; s < num_strips_; ++s) stencil::laplacian(x, y, strips_[s], inv_hx2_, inv_hy2_);
+    }
+
+    // r = f - A u on the unknowns (updates the ghost layers of u)
+    void residual(Field2D<T> &u, const Field2D<T> &f, Field2D<T> &r) {
+        PDE_PROFILE_SCOPE("poisson.residual");
+        halo_.begin(u);
+        stencil::residual(u, f, r, inner_, inv_hx2_, inv_hy2_);
+        halo_.finish(u);
+        for (int s = 0; s < num_strips_; ++s) stencil::residual(u, f, r, strips_[s], inv_hx2_, inv_hy2_);
+    }
+
+    // One (weighted) Jacobi sweep u_new = u + omega D^{-1} (f - A u) on the unknowns (updates the
+    // ghost layers of u), returns max |u_new - u| over the unknowns of this rank
+    T jacobi(Field2D<T> &u, const Field2D<T> &f, Field2D<T> &u_new, T omega = T(1)) {
+        PDE_PROFILE_SCOPE("poisson.jacobi");
+        halo_.begin(u);
+        T change = stencil::jacobi(u, f, u_new, inner_, inv_hx2_, inv_hy2_, omega);
+        halo_.finish(u);
+        for (int s = 0; s < num_strips_; ++s) {
+            change = std::max(change, stencil::jacobi(u, f, u_new, strips_[s], inv_hx2_, inv_hy2_, omega));
+        }
+        return change;
+    }
+
+    // One red-black SOR sweep in place: the cells with global i + j even first, then the odd ones
+    // (the other way round with reverse = true; a sweep followed by a reverse sweep is symmetric).
+    // Before each colour only the ghost cells of the other colour are exchanged, half of a full
+    // exchange, and no second field is written. omega = 1 is Gauss-Seidel. Returns max |change|
+    // over the unknowns of this rank. Needs an even number of points along periodic axes.
+    T sor(Field2D<T> &u, const Field2D<T> &f, T omega = T(1), bool reverse = false) {
+        PDE_PROFILE_SCOPE("poisson.sor");
+        T change = T(0);
+        for (int pass = 0; pass < 2; ++pass) {
+            const int color = reverse ? 1 - pass : pass;
+            halo_.begin_color(u, 1 - color);
+            change = std::max(change, stencil::sor(u, f, inner_, inv_hx2_, inv_hy2_, omega, color));
+            halo_.finish_color(u);
+            for (int s = 0; s < num_strips_; ++s) {
+                change = std::max(change, stencil::sor(u, f, strips_[s], inv_hx2_, inv_hy2_, omega, color));
+            }
+        }
+        return change;
+    }
+
+    // Whether sor() can be used (the red-black colouring must agree across periodic wraps)
+    bool red_black() const { return halo_.colorable(); }
+
+    // Optimal SOR weight for this operator (see stencil::sor_omega)
+    T sor_omega() const { return static_cast<T>(stencil::sor_omega(decomp_, inv_hx2_, inv_hy2_)); }
+
+    // Diagonal entry of A (the same for every unknown)
+    T diag() const { return T(2) * (inv_hx2_ + inv_hy2_); }
+    T hx() const { return hx_; }
+    T hy() const { return hy_; }
+    T inv_hx2() const { return inv_hx2_; }
+    T inv_hy2() const { return inv_hy2_; }
+
+    const Box &box() const { return box_; }
+    const Decomp2D &decomp() const { return decomp_; }
+    MPI_Comm comm() const { return decomp_.comm(); }
+    HaloExchange<T> &halo() { return halo_; }
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include "field2d.hpp"
+#include "fieldOps.hpp"
+#include "poisson2d.hpp"
+#include "solver.hpp"
+
+
+// z = r / diag(A)
+template <typename T>
+class JacobiPreconditioner : public Preconditioner<T>
+{
+    Box box_;
+    T inv_diag_;
+
+public:
+    explicit JacobiPreconditioner(const Poisson2D<T> &A) : box_(A.box()), inv_diag_(T(1) / A.diag()) {}
+
+    void apply(const Field2D<T> &r, Field2D<T> &z) override {
+        fieldops::scale(inv_diag_, r, z, box_);
+    }
+};
+
+
+// Processor-local symmetric SOR: one forward and one backward SOR sweep over the unknowns
+// of this rank, with the couplings to other ranks dropped (block Jacobi across ranks, SSOR
+// within a rank). This keeps the preconditioner symmetric positive definite for 0 < omega < 2
+// and free of communication:
+//   M = 1/(omega (2 - omega)) (D + omega L) D^{-1} (D + omega U)
+template <typename T>
+class SSORPreconditioner : public Preconditioner<T>
+{
+    Box box_;
+    T cx_, cy_, diag_, omega_;
+    Field2D<T> w_; // work array, zero outside the box so out-of-box neighbours drop out
+
+public:
+    SSORPreconditioner(const Poisson2D<T> &A, T omega = T(1))
+        : box_(A.box()), cx_(A.inv_hx2()), cy_(A.inv_hy2()), diag_(A.diag()), omega_(omega),
+          w_(A.decomp()) {}
+
+    void apply(const Field2D<T> &r, Field2D<T> &z) override {
+        const T scale = omega_ * (T(2) - omega_);
+        const T inv_diag = T(1) / diag_;
+
+        // forward sweep: (D + omega L) y = omega (2 - omega) r
+        for (int i = box_.i_begin; i < box_.i_end; ++i) {
+            const T *pr = r.row(i);
+            T *pw = w_.row(i);
+            const T *pw_left = w_.row(i - 1);
+            for (int j = box_.j_begin; j < box_.j_end; ++j) {
+                pw[j] = (scale * pr[j] + omega_ * (cx_ * pw_left[j] + cy_ * pw[j - 1])) * inv_diag;
+            }
+        }
+
+        // backward sweep: (D + omega U) z = D y, done in place
+        for (int i = box_.i_end - 1; i >= box_.i_begin; --i) {
+            T *pw = w_.row(i);
+            const T *pw_right = w_.row(i + 1);
+            for (int j = box_.j_end - 1; j >= box_.j_begin; --j) {
+                pw[j] = (diag_ * pw[j] + omega_ * (cx_ * pw_right[j] + cy_ * pw[j + 1])) * inv_diag;
+            }
+        }
+
+        fieldops::copy(w_, z, box_);
+    }
+};
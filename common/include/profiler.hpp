@@ -0,0 +1,70 @@
+#pragma once
+#include <mpi.h>
+#include <cstdio>
+#include <string>
+
+
+// Lightweight per-phase instrumentation, compiled in with the CMake option ENABLE_PROFILING
+// (which defines PDE_ENABLE_PROFILING); otherwise the macros below expand to nothing and cost
+// nothing.
+//
+//   PDE_PROFILE_SCOPE("halo.wait");        // time the rest of the enclosing scope as a region
+//   PDE_PROFILE_BYTES(neighbor, bytes);    // count one message of `bytes` sent to rank neighbor
+//
+// Regions are keyed by name (use string literals); nested scopes are timed independently, so a
+// region's time includes the regions inside it. Only the main thread of a rank records (all
+// instrumented code runs outside parallel regions, like the MPI calls).
+//
+// profiler::report() prints per region the calls and the min / avg / max time over the ranks,
+// which shows load imbalance directly, and the bytes and messages sent per rank. With the
+// environment variable PDE_TRACE=<file> set, every timed scope is also recorded as an event and
+// profiler::finish() writes them as Chrome trace JSON (one process per rank; open it in
+// chrome://tracing or Perfetto), every rank its own part of the file with MPI-IO.
+namespace profiler
+{
+
+#ifdef PDE_ENABLE_PROFILING
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+// Add one completed scope of region name, [start, end) in MPI_Wtime seconds
+void record(const char *name, double start, double end);
+// Add one message of the given size sent to rank neighbor
+void count_bytes(int neighbor, long long bytes);
+// Forget everything recorded so far (e.g. after a warm-up)
+void reset();
+
+// Collective over comm: rank 0 prints the region table and communication volume to out
+void report(MPI_Comm comm, std::FILE *out = stdout);
+// Collective over comm: writes the trace events of all ranks to path as Chrome trace JSON
+void write_trace(const std::string &path, MPI_Comm comm);
+// report(), plus write_trace() when PDE_TRACE is set; does nothing when profiling is disabled
+void finish(MPI_Comm comm);
+
+// Times its own lifetime as one call of region name
+class ScopedTimer
+{
+    const char *name_;
+    double start_;
+
+public:
+    explicit ScopedTimer(const char *name) : name_(name), start_(MPI_Wtime()) {}
+    ~ScopedTimer() { record(name_, start_, MPI_Wtime()); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+} // namespace profiler
+
+#ifdef PDE_ENABLE_PROFILING
+#define PDE_PROFILE_CONCAT2(a, b) a##b
+#define PDE_PROFILE_CONCAT(a, b) PDE_PROFILE_CONCAT2(a, b)
+#define PDE_PROFILE_SCOPE(name) profiler::ScopedTimer PDE_PROFILE_CONCAT(pde_profile_scope_, __LINE__)(name)
+#define PDE_PROFILE_BYTES(neighbor, bytes) profiler::count_bytes((neighbor), (bytes))
+#else
+#define PDE_PROFILE_SCOPE(name) ((void)0)
+#define PDE_PROFILE_BYTES(neighbor, bytes) ((void)0)
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+#include <mpi.h>
+#include <cmath>
+#include <cstdio>
+#include "field2d.hpp"
+#include "fieldOps.hpp"
+#include "poisson2d.hpp"
+#include "solver.hpp"
+
+
+// Mixed-precision iterative refinement for A x = b with A = Poisson2D<double>:
+//   r = b - A x                 (double)
+//   solve A d = r approximately (Inner, e.g. CGSolver<float> or Multigrid<float>)
+//   x = x + d                   (double)
+// The inner solver does nearly all the work and streams half the bytes of a double solve;
+// the outer loop only costs one double residual per correction, yet the final residual is
+// limited by double rather than float rounding. Each correction reduces the error by about
+// the inner relative tolerance (Inner::rtol, which should stay well above float epsilon).
+//
+// Inner must provide SolveStats solve(const Field2D<float>&, Field2D<float>&) for an operator
+// on the same decomposition and grid as A. The residual is scaled by 1 / max |r| before it is
+// rounded to float so that it neither underflows nor loses range as x converges.
+template <typename Inner>
+class IterativeRefinement
+{
+    Poisson2D<double> &A_;
+    Inner &inner_;
+    Field2D<double> r_;
+    Field2D<float> r_lo_, d_lo_;
+    int inner_iterations_ = 0;
+
+public:
+    int max_iter = 20; // refinement steps
+    double rtol = 1e-12; // stop when ||r|| <= rtol * ||b||
+    int verbose = 0; // rank 0 prints the residual after every refinement step when > 0
+
+    IterativeRefinement(Poisson2D<double> &A, Inner &inner)
+        : A_(A), inner_(inner), r_(A.decomp()), r_lo_(A.decomp()), d_lo_(A.decomp()) {}
+
+    // Solve A x = b, x holds the initial guess on entry. stats.iterations counts refinement
+    // steps, inner_iterations() the iterations of the inner solver summed over them.
+    SolveStats solve(const Field2D<double> &b, Field2D<double> &x) {
+        const Box &box = A_.box();
+        MPI_Comm comm = A_.comm();
+        SolveStats stats;
+        inner_iterations_ = 0;
+
+        double norm_b = fieldops::norm2(b, box, comm);
+        if (norm_b == 0.0) {
+            fieldops::set(x, 0.0, box);
+            stats.converged = true;
+            return stats;
+        }
+
+        A_.residual(x, b, r_);
+        stats.residual = fieldops::norm2(r_, box, comm) / norm_b;
+        for (int iter = 0; iter < max_iter; ++iter) {
+            if (stats.residual <= rtol) break;
+
+            double r_max = fieldops::local_max_abs(r_, box);
+            MPI_Allreduce(MPI_IN_PLACE, &r_max, 1, MPI_DOUBLE, MPI_MAX, comm);
+            fieldops::convert(r_, r_lo_, box, 1.0 / r_max);
+            fieldops::set(d_lo_, 0.0f, box);
+            SolveStats inner = inner_.solve(r_lo_, d_lo_);
+            inner_iterations_ += inner.iterations;
+            fieldops::add_converted(r_max, d_lo_, x, box);
+
+            A_.residual(x, b, r_);
+            double residual = fieldops::norm2(r_, box, comm) / norm_b;
+            stats.iterations = iter + 1;
+            if (verbose > 0 && A_.decomp().rank() == 0) {
+                std::printf("Refinement step %d: %d inner iterations, relative residual = %e\n",
+                            stats.iterations, inner.iterations, residual);
+            }
+            // the correction no longer helps (e.g. the inner solver diverged or rtol is unreachable)
+            const bool stalled = !(residual < stats.residual);
+            stats.residual = residual;
+            if (stalled) break;
+        }
+        stats.converged = stats.residual <= rtol;
+        return stats;
+    }
+
+    int inner_iterations() const { return inner_iterations_; }
+};
@@ -0,0 +1,22 @@
+#pragma once
+#include "field2d.hpp"
+
+
+// Outcome of an iterative solve
+struct SolveStats
+{
+    int iterations = 0;
+    double residual = 0.0; // final relative residual ||b - A x|| / ||b||
+    bool converged = false;
+};
+
+
+// z = M^{-1} r on the unknowns of an operator. Implementations must only write the cells of
+// the operator's box in z (the boundary cells of z stay zero).
+template <typename T>
+class Preconditioner
+{
+public:
+    virtual ~Preconditioner() = default;
+    virtual void apply(const Field2D<T> &r, Field2D<T> &z) = 0;
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "batchField2d.hpp"
+#include "decomp2d.hpp"
+#include "field2d.hpp"
+
+
+// 5-point finite difference kernels on Field2D, applied over a Box of local indices.
+//
+// The kernels contain no boundary logic: the caller passes the box of cells to update (see
+// dirichlet_box) and the cells around it are only read. Every x-layer of the box is handed
+// to a row kernel that is vectorised along the contiguous y-direction. The row kernels
+// exist as a scalar version and, on x86-64, as AVX2 and AVX-512 versions; the best one
+// supported by the CPU is selected at runtime on first use.
+//
+// With A = -Laplacian discretised as
+//   (A u)(i,j) = (2u(i,j) - u(i-1,j) - u(i+1,j)) / hx^2 + (2u(i,j) - u(i,j-1) - u(i,j+1)) / hy^2
+// the kernels are:
+//   laplacian: y = A u
+//   residual:  r = f - A u
+//   jacobi:    u_new = (1 - omega) u + omega (f + offdiag(u)) / diag   (omega = 1: plain Jacobi)
+//   sor:       the same update in place, on the cells of one colour of the red-black
+//              (checkerboard) ordering only; omega = 1 is Gauss-Seidel
+// laplacian, residual and jacobi also exist for BatchField2D, where the row kernels run along
+// the interleaved rows and so vectorise across the members of the batch.
+namespace stencil
+{
+
+enum class Isa { Scalar, AVX2, AVX512 };
+
+// Instruction set used by the kernels; defaults to the best supported one
+Isa active_isa();
+// Best instruction set supported by both the build and the CPU
+Isa best_isa();
+// Force an instruction set (e.g. for benchmarking); returns false and keeps the current one
+// if isa is not supported
+bool set_isa(Isa isa);
+const char *isa_name(Isa isa);
+
+void laplacian(const Field2D<float> &u, Field2D<float> &y, const Box &box, float inv_hx2, float inv_hy2);
+void laplacian(const Field2D<double> &u, Field2D<double> &y, const Box &box, double inv_hx2, double inv_hy2);
+
+void residual(const Field2D<float> &u, const Field2D<float> &f, Field2D<float> &r, const Box &box,
+              float inv_hx2, float inv_hy2);
+void residual(const Field2D<double> &u, const Field2D<double> &f, Field2D<double> &r, const Box &box,
+              double inv_hx2, double inv_hy2);
+
+// Returns max |u_new - u| over the box
+float jacobi(const Field2D<float> &u, const Field2D<float> &f, Field2D<float> &u_new, const Box &box,
+             float inv_hx2, float inv_hy2, float omega = 1.0f);
+double jacobi(const Field2D<double> &u, const Field2D<double> &f, Field2D<double> &u_new, const Box &box,
+              double inv_hx2, double inv_hy2, double omega = 1.0);
+
+// In-place SOR update of the cells of the box with (global i + global j) % 2 == color. A cell of
+// one colour only reads cells of the other colour, so the update order within a colour does not
+// matter. Returns max |change| over the updated cells.
+float sor(Field2D<float> &u, const Field2D<float> &f, const Box &box, float inv_hx2, float inv_hy2, float omega,
+          int color);
+double sor(Field2D<double> &u, const Field2D<double> &f, const Box &box, double inv_hx2, double inv_hy2, double omega,
+           int color);
+
+// Batched versions, every member of the batch on the same box (jacobi: max over all members)
+void laplacian(const BatchField2D<float> &u, BatchField2D<float> &y, const Box &box, float inv_hx2, float inv_hy2);
+void laplacian(const BatchField2D<double> &u, BatchField2D<double> &y, const Box &box, double inv_hx2,
+               double inv_hy2);
+
+void residual(const BatchField2D<float> &u, const BatchField2D<float> &f, BatchField2D<float> &r, const Box &box,
+              float inv_hx2, float inv_hy2);
+void residual(const BatchField2D<double> &u, const BatchField2D<double> &f, BatchField2D<double> &r, const Box &box,
+              double inv_hx2, double inv_hy2);
+
+float jacobi(const BatchField2D<float> &u, const BatchField2D<float> &f, BatchField2D<float> &u_new, const Box &box,
+             float inv_hx2, float inv_hy2, float omega = 1.0f);
+double jacobi(const BatchField2D<double> &u, const BatchField2D<double> &f, BatchField2D<double> &u_new,
+              const Box &box, double inv_hx2, double inv_hy2, double omega = 1.0);
+
+// Extreme eigenvalues of D^-1 A for the operator above on the grid of decomp (D its diagonal),
+// known in closed form for constant coefficients: the grid modes with angles (theta_x, theta_y)
+// have the eigenvalues
+//   1 - (cos(theta_x) / hx^2 + cos(theta_y) / hy^2) / (1 / hx^2 + 1 / hy^2)
+// with theta = k pi / (N - 1), k = 1 .. N-2 along a Dirichlet axis and theta = 2 pi k / N along
+// a periodic one. lower is the smallest non-zero eigenvalue (constants are in the null space of
+// a fully periodic A), 1 - lower the spectral radius of Jacobi on the Dirichlet problem.
+struct Spectrum { double lower, upper; };
+
+inline Spectrum jacobi_spectrum(const Decomp2D &decomp, double inv_hx2, double inv_hy2) {
+    const double pi = std::acos(-1.0);
+    // largest and smallest cos(theta) of the modes of one axis
+    auto cos_range = [pi](int N, bool periodic, double &c_max, double &c_min) {
+        if (periodic) {
+            c_max = 1.0;
+            c_min = std::cos(2.0 * pi * (N / 2) / N);
+        }
+        else {
+            c_max = std::cos(pi / (N - 1));
+            c_min = -c_max;
+        }
+    };
+    double cx_max, cx_min, cy_max, cy_min;
+    cos_range(decomp.Nx(), decomp.periodic_x(), cx_max, cx_min);
+    cos_range(decomp.Ny(), decomp.periodic_y(), cy_max, cy_min);
+    const double sum = inv_hx2 + inv_hy2;
+    double slowest = inv_hx2 * cx_max + inv_hy2 * cy_max;
+    if (decomp.periodic_x() && decomp.periodic_y()) {
+        // the constant mode is excluded: the next one varies along one axis only
+        slowest = std::max(inv_hx2 * std::cos(2.0 * pi / decomp.Nx()) + inv_hy2,
+                           inv_hx2 + inv_hy2 * std::cos(2.0 * pi / decomp.Ny()));
+    }
+    return {1.0 - slowest / sum, 1.0 - (inv_hx2 * cx_min + inv_hy2 * cy_min) / sum};
+}
+
+// Optimal SOR weight 2 / (1 + sqrt(1 - rho^2)) for the operator above on the grid of decomp,
+// with the spectral radius rho = 1 - lower of Jacobi from jacobi_spectrum
+inline double sor_omega(const Decomp2D &decomp, double inv_hx2, double inv_hy2) {
+    const double rho = 1.0 - jacobi_spectrum(decomp, inv_hx2, inv_hy2).lower;
+    return 2.0 / (1.0 + std::sqrt(1.0 - rho * rho));
+}
+
+// Owned cells of this rank that are not on the global boundary i = 0, Nx-1, j = 0, Ny-1, as a
+// box of local indices; these are the unknowns of a problem with Dirichlet boundary values.
+// A periodic axis has no boundary, all owned cells along it are unknowns.
+inline Box dirichlet_box(const Decomp2D &decomp) {
+    Box box{0, decomp.nx(), 0, decomp.ny()};
+    if (!decomp.periodic_x()) {
+        box.i_begin = std::max(1, decomp.i0()) - decomp.i0();
+        box.i_end = std::min(decomp.Nx() - 1, decomp.i1()) - decomp.i0();
+    }
+    if (!decomp.periodic_y()) {
+        box.j_begin = std::max(1, decomp.j0()) - decomp.j0();
+        box.j_end = std::min(decomp.Ny() - 1, decomp.j1()) - decomp.j0();
+    }
+    return box;
+}
+
+} // namespace stencil
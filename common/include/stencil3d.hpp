@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include "decomp3d.hpp"
+#include "field3d.hpp"
+
+
+// 7-point finite difference kernels on Field3D, applied over a Box3D of local indices; the 3D
+// counterparts of the kernels in stencil.hpp, with the same division of labour (no boundary
+// logic, see dirichlet_box). Every z-row of the box is one loop along the contiguous
+// z-direction, left to the compiler to vectorise.
+//
+// With A = -Laplacian discretised as
+//   (A u)(i,j,k) = (2u - u(i-1) - u(i+1)) / hx^2 + (2u - u(j-1) - u(j+1)) / hy^2 + (2u - u(k-1) - u(k+1)) / hz^2
+// the kernels are:
+//   laplacian: y = A u
+//   residual:  r = f - A u
+//   jacobi:    u_new = (1 - omega) u + omega (f + offdiag(u)) / diag   (omega = 1: plain Jacobi)
+namespace stencil
+{
+
+void laplacian(const Field3D<float> &u, Field3D<float> &y, const Box3D &box,
+               float inv_hx2, float inv_hy2, float inv_hz2);
+void laplacian(const Field3D<double> &u, Field3D<double> &y, const Box3D &box,
+               double inv_hx2, double inv_hy2, double inv_hz2);
+
+void residual(const Field3D<float> &u, const Field3D<float> &f, Field3D<float> &r, const Box3D &box,
+              float inv_hx2, float inv_hy2, float inv_hz2);
+void residual(const Field3D<double> &u, const Field3D<double> &f, Field3D<double> &r, const Box3D &box,
+              double inv_hx2, double inv_hy2, double inv_hz2);
+
+// Returns max |u_new - u| over the box
+float jacobi(const Field3D<float> &u, const Field3D<float> &f, Field3D<float> &u_new, const Box3D &box,
+             float inv_hx2, float inv_hy2, float inv_hz2, float omega = 1.0f);
+double jacobi(const Field3D<double> &u, const Field3D<double> &f, Field3D<double> &u_new, const Box3D &box,
+              double inv_hx2, double inv_hy2, double inv_hz2, double omega = 1.0);
+
+// Owned cells of this rank that are not on the global boundary of a non-periodic axis, as a
+// box of local indices (the unknowns of a Dirichlet problem)
+inline Box3D dirichlet_box(const Decomp3D &decomp) {
+    Box3D box{0, decomp.nx(), 0, decomp.ny(), 0, decomp.nz()};
+    if (!decomp.periodic_x()) {
+        box.i_begin = std::max(1, decomp.i0()) - decomp.i0();
+        box.i_end = std::min(decomp.Nx() - 1, decomp.i1()) - decomp.i0();
+    }
+    if (!decomp.periodic_y()) {
+        box.j_begin = std::max(1, decomp.j0()) - decomp.j0();
+        box.j_end = std::min(decomp.Ny() - 1, decomp.j1()) - decomp.j0();
+    }
+    if (!decomp.periodic_z()) {
+        box.k_begin = std::max(1, decomp.k0()) - decomp.k0();
+        box.k_end = std::min(decomp.Nz() - 1, decomp.k1()) - decomp.k0();
+    }
+    return box;
+}
+
+} // namespace stencil
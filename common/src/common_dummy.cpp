@@ -1 +0,0 @@
-int common_dummy() { return 0; }
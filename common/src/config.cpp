@@ -0,0 +1,229 @@
+#include "config.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+
+std::string trim(const std::string &s)
+{
+    const char *space = " \t\r\n";
+    std::size_t begin = s.find_first_not_of(space);
+    if (begin == std::string::npos) return "";
+    return s.substr(begin, s.find_last_not_of(space) - begin + 1);
+}
+
+// Items of a comma-separated list, trimmed, empty items skipped
+std::vector<std::string> split_list(const std::string &s)
+{
+    std::vector<std::string> items;
+    std::istringstream in(s);
+    for (std::string item; std::getline(in, item, ',');) {
+        item = trim(item);
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+} // namespace
+
+Config::Config(int argc, char **argv, MPI_Comm comm, std::initializer_list<const char*> positional) : comm_(comm)
+{
+    MPI_Comm_rank(comm, &rank_);
+
+    // rank 0 reads the command line and the files, the other ranks get the result
+    std::string text;
+    if (rank_ == 0) {
+        std::vector<std::string> names(positional.begin(), positional.end());
+        int position = 0;
+        for (int k = 1; k < argc; ++k) {
+            std::string arg = argv[k];
+            if (arg.compare(0, 2, "--") != 0) ++position;
+            parse_argument(arg, position - 1, names);
+        }
+        for (const auto &entry : values_) text += entry.first + '\n' + entry.second + '\n';
+    }
+    int len = static_cast<int>(text.size());
+    MPI_Bcast(&len, 1, MPI_INT, 0, comm);
+    text.resize(len);
+    MPI_Bcast(&text[0], len, MPI_CHAR, 0, comm);
+    if (rank_ != 0) {
+        std::istringstream in(text);
+        for (std::string key, value; std::getline(in, key) && std::getline(in, value);) values_[key] = value;
+    }
+}
+
+void Config::parse_argument(const std::string &arg, int position, const std::vector<std::string> &positional)
+{
+    if (arg.compare(0, 2, "--") != 0) {
+        if (position >= static_cast<int>(positional.size())) fail("unexpected argument '" + arg + "'");
+        set(positional[position], arg, "argument " + std::to_string(position + 1));
+        return;
+    }
+    std::size_t eq = arg.find('=');
+    std::string key = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+    std::string value = eq == std::string::npos ? "true" : arg.substr(eq + 1);
+    if (key == "config") parse_file(value);
+    else set(key, value, "'" + arg + "'");
+}
+
+void Config::parse_file(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in) fail("cannot open config file '" + path + "'");
+    int number = 0;
+    for (std::string line; std::getline(in, line);) {
+        ++number;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        std::size_t eq = line.find('=');
+        const std::string where = path + ":" + std::to_string(number);
+        if (eq == std::string::npos) fail(where + ": expected 'key = value'");
+        set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), where);
+    }
+}
+
+void Config::set(const std::string &key, const std::string &value, const std::string &where)
+{
+    if (key.empty() || key.find_first_of(" \t=") != std::string::npos) fail(where + ": invalid option name '" + key + "'");
+    values_[key] = value;
+}
+
+void Config::fail(const std::string &message) const
+{
+    // every rank finds the same error; rank 0 reports it before taking the job down
+    if (rank_ == 0) {
+        std::fprintf(stderr, "Error: %s\n", message.c_str());
+        std::fflush(stderr);
+        MPI_Abort(comm_, 1);
+    }
+    MPI_Barrier(comm_);
+    MPI_Abort(comm_, 1);
+    std::abort();
+}
+
+const std::string *Config::find(const std::string &key) const
+{
+    asked_.insert(key);
+    auto it = values_.find(key);
+    return it == values_.end() ? nullptr : &it->second;
+}
+
+bool Config::has(const std::string &key) const
+{
+    return find(key) != nullptr;
+}
+
+std::string Config::get(const std::string &key, const std::string &def) const
+{
+    const std::string *value = find(key);
+    return used_[key] = value ? *value : def;
+}
+
+int Config::get_int(const std::string &key, int def) const
+{
+    const std::string *value = find(key);
+    if (!value) {
+        used_[key] = std::to_string(def);
+        return def;
+    }
+    char *end = nullptr;
+    errno = 0;
+    long result = std::strtol(value->c_str(), &end, 10);
+    if (value->empty() || *end != '\0' || errno != 0 || result != static_cast<int>(result)) {
+        fail("option " + key + " = '" + *value + "' is not an integer");
+    }
+    used_[key] = *value;
+    return static_cast<int>(result);
+}
+
+double Config::get_double(const std::string &key, double def) const
+{
+    const std::string *value = find(key);
+    if (!value) {
+        std::ostringstream text;
+        text << def;
+        used_[key] = text.str();
+        return def;
+    }
+    char *end = nullptr;
+    double result = std::strtod(value->c_str(), &end);
+    if (value->empty() || *end != '\0') fail("option " + key + " = '" + *value + "' is not a number");
+    used_[key] = *value;
+    return result;
+}
+
+bool Config::get_bool(const std::string &key, bool def) const
+{
+    const std::string *value = find(key);
+    if (!value) {
+        used_[key] = def ? "true" : "false";
+        return def;
+    }
+    bool result;
+    if (*value == "true" || *value == "1" || *value == "yes" || *value == "on" || *value == key) result = true;
+    else if (*value == "false" || *value == "0" || *value == "no" || *value == "off") result = false;
+    else fail("option " + key + " = '" + *value + "' is not a boolean");
+    used_[key] = result ? "true" : "false";
+    return result;
+}
+
+std::string Config::get_choice(const std::string &key, const std::string &def,
+                               std::initializer_list<const char*> allowed) const
+{
+    std::string value = get(key, def);
+    std::string list;
+    for (const char *choice : allowed) {
+        if (value == choice) return value;
+        list += (list.empty() ? "" : "|") + std::string(choice);
+    }
+    fail("option " + key + " = '" + value + "' is not one of " + list);
+}
+
+std::vector<int> Config::get_int_list(const std::string &key, const std::string &def) const
+{
+    std::vector<int> result;
+    for (const std::string &item : split_list(get(key, def))) {
+        char *end = nullptr;
+        errno = 0;
+        long v = std::strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || errno != 0 || v != static_cast<int>(v)) {
+            fail("option " + key + ": '" + item + "' is not an integer");
+        }
+        result.push_back(static_cast<int>(v));
+    }
+    if (result.empty()) fail("option " + key + " is an empty list");
+    return result;
+}
+
+std::vector<std::string> Config::get_choice_list(const std::string &key, const std::string &def,
+                                                 std::initializer_list<const char*> allowed) const
+{
+    std::vector<std::string> result = split_list(get(key, def));
+    std::string list;
+    for (const char *choice : allowed) list += (list.empty() ? "" : "|") + std::string(choice);
+    for (const std::string &item : result) {
+        bool known = false;
+        for (const char *choice : allowed) known = known || item == choice;
+        if (!known) fail("option " + key + ": '" + item + "' is not one of " + list);
+    }
+    if (result.empty()) fail("option " + key + " is an empty list");
+    return result;
+}
+
+void Config::print(std::FILE *out) const
+{
+    if (rank_ != 0) return;
+    for (const auto &entry : used_) std::fprintf(out, "%s = %s\n", entry.first.c_str(), entry.second.c_str());
+}
+
+void Config::check_unused() const
+{
+    std::string unknown;
+    for (const auto &entry : values_) {
+        if (asked_.count(entry.first) == 0) unknown += " " + entry.first;
+    }
+    if (!unknown.empty()) fail("unknown option(s):" + unknown);
+}
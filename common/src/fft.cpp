@@ -0,0 +1,204 @@
+#include "fft.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <complex>
+#include <vector>
+#ifdef PDE_HAVE_FFTW
+#include <fftw3.h>
+#endif
+
+#ifdef PDE_HAVE_FFTW
+
+struct fft::DST1::Impl
+{
+    fftw_plan plan;
+
+    explicit Impl(int m)
+    {
+        // planned once for a single line; the new-array execute runs it on any (unaligned) line
+        std::vector<double> line(m);
+        plan = fftw_plan_r2r_1d(m, line.data(), line.data(), FFTW_RODFT00, FFTW_ESTIMATE | FFTW_UNALIGNED);
+    }
+
+    ~Impl() { fftw_destroy_plan(plan); }
+
+    void apply(double *data, int count, long long stride, int m) const
+    {
+        PDE_OMP(parallel for schedule(static) if(static_cast<long long>(count) * m >= parallel::min_parallel))
+        for (int l = 0; l < count; ++l) fftw_execute_r2r(plan, data + l * stride, data + l * stride);
+    }
+};
+
+const char *fft::backend()
+{
+    return "FFTW";
+}
+
+#else
+
+namespace
+{
+
+using cd = std::complex<double>;
+
+// Iterative radix-2 FFT (forward, e^{-2 pi i j k / n}) of a power-of-two length n
+class Radix2
+{
+    int n_;
+    std::vector<int> reverse_;
+    std::vector<cd> twiddle_;
+
+public:
+    explicit Radix2(int n) : n_(n), reverse_(n), twiddle_(n / 2)
+    {
+        int bits = 0;
+        while ((1 << bits) < n) ++bits;
+        for (int k = 0; k < n; ++k) {
+            int r = 0;
+            for (int b = 0; b < bits; ++b) r |= ((k >> b) & 1) << (bits - 1 - b);
+            reverse_[k] = r;
+        }
+        const double pi = std::acos(-1.0);
+        for (int k = 0; k < n / 2; ++k) twiddle_[k] = std::polar(1.0, -2.0 * pi * k / n);
+    }
+
+    int size() const { return n_; }
+
+    void forward(cd *a) const
+    {
+        for (int k = 0; k < n_; ++k) {
+            if (k < reverse_[k]) std::swap(a[k], a[reverse_[k]]);
+        }
+        for (int len = 2; len <= n_; len <<= 1) {
+            const int half = len / 2, step = n_ / len;
+            for (int i = 0; i < n_; i += len) {
+                for (int k = 0; k < half; ++k) {
+                    const cd v = a[i + k + half] * twiddle_[k * step];
+                    a[i + k + half] = a[i + k] - v;
+                    a[i + k] += v;
+                }
+            }
+        }
+    }
+};
+
+bool power_of_two(int n)
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+// Forward complex FFT of any length n: radix-2 directly, or Bluestein's algorithm, which writes
+// the DFT as a convolution with the chirp e^{-i pi k^2 / n} and evaluates that with radix-2 FFTs
+// of length M >= 2n - 1
+class ComplexFFT
+{
+    int n_;
+    bool direct_;
+    Radix2 radix2_;
+    std::vector<cd> chirp_; // e^{-i pi k^2 / n}
+    std::vector<cd> kernel_; // FFT of the conjugate chirp wrapped around to length M
+
+    static int bluestein_size(int n)
+    {
+        int m = 1;
+        while (m < 2 * n - 1) m <<= 1;
+        return m;
+    }
+
+public:
+    explicit ComplexFFT(int n)
+        : n_(n), direct_(power_of_two(n)), radix2_(direct_ ? n : bluestein_size(n))
+    {
+        if (direct_) return;
+        const double pi = std::acos(-1.0);
+        const int M = radix2_.size();
+        chirp_.resize(n);
+        for (long long k = 0; k < n; ++k) {
+            // k^2 mod 2n keeps the angle small and exact for large k
+            chirp_[k] = std::polar(1.0, -pi * static_cast<double>((k * k) % (2LL * n)) / n);
+        }
+        kernel_.assign(M, cd(0.0, 0.0));
+        kernel_[0] = std::conj(chirp_[0]);
+        for (int k = 1; k < n; ++k) kernel_[k] = kernel_[M - k] = std::conj(chirp_[k]);
+        radix2_.forward(kernel_.data());
+    }
+
+    // Size of the work array forward() needs
+    int work_size() const { return direct_ ? 0 : radix2_.size(); }
+
+    void forward(cd *a, cd *work) const
+    {
+        if (direct_) {
+            radix2_.forward(a);
+            return;
+        }
+        const int M = radix2_.size();
+        for (int k = 0; k < n_; ++k) work[k] = a[k] * chirp_[k];
+        for (int k = n_; k < M; ++k) work[k] = cd(0.0, 0.0);
+        radix2_.forward(work);
+        // inverse FFT of the product as conj(FFT(conj(.))) / M
+        for (int k = 0; k < M; ++k) work[k] = std::conj(work[k] * kernel_[k]);
+        radix2_.forward(work);
+        const double scale = 1.0 / M;
+        for (int k = 0; k < n_; ++k) a[k] = std::conj(work[k]) * scale * chirp_[k];
+    }
+};
+
+} // namespace
+
+// The odd extension [0, x_0 .. x_{m-1}, 0, -x_{m-1} .. -x_0] of length 2 (m + 1) has the
+// purely imaginary DFT -i y. Two real lines a and b packed as a + i b therefore give
+// Z = -i y_a + y_b, so y_a = -Im Z and y_b = Re Z from a single complex FFT.
+struct fft::DST1::Impl
+{
+    ComplexFFT fft;
+
+    explicit Impl(int m) : fft(2 * (m + 1)) {}
+
+    void apply(double *data, int count, long long stride, int m) const
+    {
+        const int n = 2 * (m + 1);
+        const int pairs = (count + 1) / 2;
+        PDE_OMP(parallel if(static_cast<long long>(count) * m >= parallel::min_parallel))
+        {
+            std::vector<cd> z(n), work(fft.work_size());
+            PDE_OMP(for schedule(static))
+            for (int p = 0; p < pairs; ++p) {
+                double *a = data + 2LL * p * stride;
+                double *b = 2 * p + 1 < count ? a + stride : nullptr;
+                z[0] = z[m + 1] = cd(0.0, 0.0);
+                for (int j = 0; j < m; ++j) {
+                    const cd v(a[j], b ? b[j] : 0.0);
+                    z[j + 1] = v;
+                    z[n - 1 - j] = -v;
+                }
+                fft.forward(z.data(), work.data());
+                for (int k = 0; k < m; ++k) a[k] = -z[k + 1].imag();
+                if (b) {
+                    for (int k = 0; k < m; ++k) b[k] = z[k + 1].real();
+                }
+            }
+        }
+    }
+};
+
+const char *fft::backend()
+{
+    return "in-tree FFT";
+}
+
+#endif
+
+namespace fft
+{
+
+DST1::DST1(int m) : m_(m), impl_(m > 0 ? new Impl(m) : nullptr) {}
+
+DST1::~DST1() = default;
+
+void DST1::apply(double *data, int count, long long stride) const
+{
+    if (impl_ && count > 0) impl_->apply(data, count, stride, m_);
+}
+
+} // namespace fft
@@ -0,0 +1,264 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+struct Region
+{
+    long long calls = 0;
+    double total = 0.0;
+};
+
+struct Link
+{
+    long long bytes = 0;
+    long long messages = 0;
+};
+
+struct Event
+{
+    const char *name;
+    double start, end;
+};
+
+// Tracing is switched on by PDE_TRACE; the events of very long runs are capped
+constexpr std::size_t max_events = 1 << 20;
+
+struct State
+{
+    std::unordered_map<const char*, Region> regions; // keyed by the literal, merged by name in report()
+    std::map<int, Link> links; // by neighbour rank
+    std::vector<Event> events;
+    bool trace = std::getenv("PDE_TRACE") != nullptr;
+    long long dropped = 0;
+};
+
+State &state()
+{
+    static State s;
+    return s;
+}
+
+// Concatenation of the strings of all ranks on rank 0 (empty elsewhere); for short texts such
+// as the region names, the lengths are int
+std::string gather_text(const std::string &text, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int len = static_cast<int>(text.size());
+    std::vector<int> lens(size), displs(size);
+    MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, comm);
+    int total = 0;
+    for (int r = 0; r < size; ++r) {
+        displs[r] = total;
+        total += lens[r];
+    }
+    std::string all(rank == 0 ? total : 0, '\0');
+    MPI_Gatherv(text.data(), len, MPI_CHAR, &all[0], lens.data(), displs.data(), MPI_CHAR, 0, comm);
+    return all;
+}
+
+// Union of the region names of all ranks, in the same order on every rank
+std::vector<std::string> all_names(const std::map<std::string, Region> &local, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    std::string text;
+    for (const auto &entry : local) text += entry.first + '\n';
+    std::string all = gather_text(text, comm);
+
+    std::set<std::string> names;
+    std::istringstream in(all);
+    for (std::string name; std::getline(in, name);) names.insert(name);
+    std::string joined;
+    for (const std::string &name : names) joined += name + '\n';
+
+    int len = static_cast<int>(joined.size());
+    MPI_Bcast(&len, 1, MPI_INT, 0, comm);
+    joined.resize(len);
+    MPI_Bcast(&joined[0], len, MPI_CHAR, 0, comm);
+    std::vector<std::string> result;
+    std::istringstream names_in(joined);
+    for (std::string name; std::getline(names_in, name);) result.push_back(name);
+    return result;
+}
+
+} // namespace
+
+namespace profiler
+{
+
+void record(const char *name, double start, double end)
+{
+    State &s = state();
+    Region &r = s.regions[name];
+    ++r.calls;
+    r.total += end - start;
+    if (s.trace) {
+        if (s.events.size() < max_events) s.events.push_back({name, start, end});
+        else ++s.dropped;
+    }
+}
+
+void count_bytes(int neighbor, long long bytes)
+{
+    Link &link = state().links[neighbor];
+    link.bytes += bytes;
+    ++link.messages;
+}
+
+void reset()
+{
+    State &s = state();
+    s.regions.clear();
+    s.links.clear();
+    s.events.clear();
+    s.dropped = 0;
+}
+
+void report(MPI_Comm comm, std::FILE *out)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    State &s = state();
+
+    // the same literal may live at several addresses, merge by name
+    std::map<std::string, Region> local;
+    for (const auto &entry : s.regions) {
+        Region &r = local[entry.first];
+        r.calls += entry.second.calls;
+        r.total += entry.second.total;
+    }
+    std::vector<std::string> names = all_names(local, comm);
+    const int n = static_cast<int>(names.size());
+
+    std::vector<double> times(n, 0.0), calls(n, 0.0);
+    for (int k = 0; k < n; ++k) {
+        auto it = local.find(names[k]);
+        if (it == local.end()) continue;
+        times[k] = it->second.total;
+        calls[k] = static_cast<double>(it->second.calls);
+    }
+    std::vector<double> tmin(n), tmax(n), tsum(n), cmax(n);
+    MPI_Reduce(times.data(), tmin.data(), n, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(times.data(), tmax.data(), n, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(times.data(), tsum.data(), n, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(calls.data(), cmax.data(), n, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+    // communication volume per rank and the heaviest single link
+    double volume[2] = {0.0, 0.0}; // bytes, messages
+    long long heaviest[2] = {0, -1}; // bytes, neighbour
+    for (const auto &entry : s.links) {
+        volume[0] += static_cast<double>(entry.second.bytes);
+        volume[1] += static_cast<double>(entry.second.messages);
+        if (entry.second.bytes > heaviest[0]) {
+            heaviest[0] = entry.second.bytes;
+            heaviest[1] = entry.first;
+        }
+    }
+    double vmin[2], vmax[2], vsum[2];
+    MPI_Reduce(volume, vmin, 2, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(volume, vmax, 2, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(volume, vsum, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+    std::vector<long long> links(rank == 0 ? 2 * size : 0);
+    MPI_Gather(heaviest, 2, MPI_LONG_LONG, links.data(), 2, MPI_LONG_LONG, 0, comm);
+
+    if (rank != 0) return;
+    std::fprintf(out, "Profile of %d ranks (seconds per rank: min / avg / max, imbalance = max / avg)\n", size);
+    std::fprintf(out, "%-24s %10s %11s %11s %11s %9s\n", "region", "calls", "min", "avg", "max", "imbalance");
+    for (int k = 0; k < n; ++k) {
+        double avg = tsum[k] / size;
+        std::fprintf(out, "%-24s %10.0f %11.4e %11.4e %11.4e %9.2f\n", names[k].c_str(), cmax[k], tmin[k], avg, tmax[k],
+                     avg > 0.0 ? tmax[k] / avg : 1.0);
+    }
+    if (vsum[1] > 0.0) {
+        std::fprintf(out, "Bytes sent per rank: min %.4g / avg %.4g / max %.4g MB, %.0f messages on average\n",
+                     vmin[0] / 1e6, vsum[0] / size / 1e6, vmax[0] / 1e6, vsum[1] / size);
+        int worst = 0;
+        for (int r = 1; r < size; ++r) {
+            if (links[2 * r] > links[2 * worst]) worst = r;
+        }
+        std::fprintf(out, "Heaviest link: rank %d -> rank %lld, %.4g MB\n", worst, links[2 * worst + 1],
+                     links[2 * worst] / 1e6);
+    }
+}
+
+void write_trace(const std::string &path, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    State &s = state();
+
+    // common time origin: the earliest event of any rank
+    double first = s.events.empty() ? MPI_Wtime() : s.events.front().start;
+    for (const Event &e : s.events) first = std::min(first, e.start);
+    MPI_Allreduce(MPI_IN_PLACE, &first, 1, MPI_DOUBLE, MPI_MIN, comm);
+
+    // Every rank formats its own events and writes them at its offset in the file, so no rank
+    // holds more than its own part. Rank 0 opens the array with its process name, every other
+    // event is preceded by the separator and the last rank closes the array.
+    std::ostringstream text;
+    text.precision(3);
+    text << std::fixed;
+    if (rank == 0) text << "{\"traceEvents\":[\n";
+    else text << ",\n";
+    text << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << rank << ",\"args\":{\"name\":\"rank " << rank << "\"}}";
+    for (const Event &e : s.events) {
+        text << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":" << rank << ",\"tid\":0,\"ts\":"
+             << (e.start - first) * 1e6 << ",\"dur\":" << (e.end - e.start) * 1e6 << "}";
+    }
+    if (rank == size - 1) text << "\n]}\n";
+    const std::string part = text.str();
+
+    // 64-bit offsets: a capped trace is tens of MB per rank, the file many GB at scale
+    long long length = static_cast<long long>(part.size()), offset = 0;
+    MPI_Exscan(&length, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) offset = 0; // MPI_Exscan leaves it undefined on rank 0
+
+    MPI_File fh;
+    int err = MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    if (err != MPI_SUCCESS) {
+        if (rank == 0) std::fprintf(stderr, "Error: cannot open trace file '%s'\n", path.c_str());
+        return;
+    }
+    MPI_File_set_size(fh, 0);
+    // MPI counts are int: collective writes of at most 1 GiB per rank, as many rounds as the
+    // longest part needs
+    const long long chunk = 1LL << 30;
+    long long rounds = (length + chunk - 1) / chunk;
+    MPI_Allreduce(MPI_IN_PLACE, &rounds, 1, MPI_LONG_LONG, MPI_MAX, comm);
+    for (long long k = 0; k < rounds; ++k) {
+        long long begin = std::min(k * chunk, length);
+        int count = static_cast<int>(std::min(chunk, length - begin));
+        MPI_File_write_at_all(fh, static_cast<MPI_Offset>(offset + begin), part.data() + begin, count, MPI_CHAR,
+                              MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&fh);
+
+    long long dropped = s.dropped;
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &dropped, &dropped, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    if (rank != 0) return;
+    std::printf("Trace written to %s", path.c_str());
+    if (dropped > 0) std::printf(" (%lld events beyond the limit dropped)", dropped);
+    std::printf("\n");
+}
+
+void finish(MPI_Comm comm)
+{
+    if (!enabled) return;
+    report(comm);
+    const char *trace = std::getenv("PDE_TRACE");
+    if (trace) write_trace(trace, comm);
+}
+
+} // namespace profiler
@@ -0,0 +1,275 @@
+#include "stencil.hpp"
+#include "parallel.hpp"
+#define PDE_STENCIL_ROW_TEMPLATES
+#include "stencil_rows.hpp"
+
+namespace
+{
+
+// Scalar "vector" of width one, the fallback for every CPU
+template <typename S>
+struct ScalarVec
+{
+    using T = S;
+    using reg = S;
+    static constexpr int width = 1;
+    static reg set1(T x) { return x; }
+    static reg zero() { return T(0); }
+    static reg load(const T *p) { return *p; }
+    static void store(T *p, reg a) { *p = a; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg abs(reg a) { return a < T(0) ? -a : a; }
+    static reg max(reg a, reg b) { return a > b ? a : b; }
+    static T hmax(reg a) { return a; }
+};
+
+const stencil::RowKernels<float> scalar_float = make_row_kernels<ScalarVec<float>>();
+const stencil::RowKernels<double> scalar_double = make_row_kernels<ScalarVec<double>>();
+
+bool cpu_supports(stencil::Isa isa)
+{
+    switch (isa) {
+    case stencil::Isa::Scalar:
+        return true;
+    case stencil::Isa::AVX2:
+#if defined(PDE_STENCIL_AVX2)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    case stencil::Isa::AVX512:
+#if defined(PDE_STENCIL_AVX512)
+        return __builtin_cpu_supports("avx512f");
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+// Currently selected kernels, resolved on first use
+struct Dispatch
+{
+    stencil::Isa isa;
+    const stencil::RowKernels<float> *f;
+    const stencil::RowKernels<double> *d;
+};
+
+Dispatch make_dispatch(stencil::Isa isa)
+{
+    switch (isa) {
+#if defined(PDE_STENCIL_AVX512)
+    case stencil::Isa::AVX512:
+        return {isa, &stencil::avx512_kernels_float(), &stencil::avx512_kernels_double()};
+#endif
+#if defined(PDE_STENCIL_AVX2)
+    case stencil::Isa::AVX2:
+        return {isa, &stencil::avx2_kernels_float(), &stencil::avx2_kernels_double()};
+#endif
+    default:
+        return {stencil::Isa::Scalar, &scalar_float, &scalar_double};
+    }
+}
+
+Dispatch &dispatch()
+{
+    static Dispatch d = make_dispatch(stencil::best_isa());
+    return d;
+}
+
+template <typename T> const stencil::RowKernels<T> &kernels();
+template <> const stencil::RowKernels<float> &kernels<float>() { return *dispatch().f; }
+template <> const stencil::RowKernels<double> &kernels<double>() { return *dispatch().d; }
+
+// Values per cell of a row, i.e. the distance of the y-neighbours: 1 for a Field2D, the batch
+// size for the interleaved rows of a BatchField2D
+template <typename T> int interleave(const Field2D<T> &) { return 1; }
+template <typename T> int interleave(const BatchField2D<T> &u) { return u.batch(); }
+
+template <template <typename> class F, typename T>
+void laplacian_box(const F<T> &u, F<T> &y, const Box &box, T cx, T cy)
+{
+    if (box.empty()) return;
+    const auto &k = kernels<T>();
+    const int dy = interleave(u);
+    const int n = (box.j_end - box.j_begin) * dy;
+    PDE_OMP(parallel for schedule(static) if(box.count() * dy >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        k.laplacian(u.row(i, box.j_begin), u.row(i - 1, box.j_begin), u.row(i + 1, box.j_begin),
+                    y.row(i, box.j_begin), n, dy, cx, cy);
+    }
+}
+
+template <template <typename> class F, typename T>
+void residual_box(const F<T> &u, const F<T> &f, F<T> &r, const Box &box, T cx, T cy)
+{
+    if (box.empty()) return;
+    const auto &k = kernels<T>();
+    const int dy = interleave(u);
+    const int n = (box.j_end - box.j_begin) * dy;
+    PDE_OMP(parallel for schedule(static) if(box.count() * dy >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        k.residual(u.row(i, box.j_begin), u.row(i - 1, box.j_begin), u.row(i + 1, box.j_begin),
+                   f.row(i, box.j_begin), r.row(i, box.j_begin), n, dy, cx, cy);
+    }
+}
+
+template <template <typename> class F, typename T>
+T jacobi_box(const F<T> &u, const F<T> &f, F<T> &u_new, const Box &box, T cx, T cy, T omega)
+{
+    if (box.empty()) return T(0);
+    const auto &k = kernels<T>();
+    const int dy = interleave(u);
+    const int n = (box.j_end - box.j_begin) * dy;
+    const T inv_diag = T(1) / (T(2) * (cx + cy));
+    T max_change = T(0);
+    PDE_OMP(parallel for schedule(static) reduction(max:max_change) if(box.count() * dy >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        T m = k.jacobi(u.row(i, box.j_begin), u.row(i - 1, box.j_begin), u.row(i + 1, box.j_begin),
+                       f.row(i, box.j_begin), u_new.row(i, box.j_begin), n, dy, cx, cy, inv_diag, omega);
+        max_change = m > max_change ? m : max_change;
+    }
+    return max_change;
+}
+
+// Strided along the row (every other cell), so it is not worth a SIMD row kernel
+template <typename T>
+T sor_box(Field2D<T> &u, const Field2D<T> &f, const Box &box, T cx, T cy, T omega, int color)
+{
+    if (box.empty()) return T(0);
+    const T inv_diag = T(1) / (T(2) * (cx + cy));
+    T max_change = T(0);
+    PDE_OMP(parallel for schedule(static) reduction(max:max_change) if(box.count() >= 2 * parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        T *pu = u.row(i);
+        const T *pl = u.row(i - 1), *pr = u.row(i + 1), *pf = f.row(i);
+        // first cell of the colour in this row
+        const int j_first = box.j_begin + ((u.global_i(i) + u.global_j(box.j_begin) + color) & 1);
+        for (int j = j_first; j < box.j_end; j += 2) {
+            T change = omega * ((pf[j] + cx * (pl[j] + pr[j]) + cy * (pu[j - 1] + pu[j + 1])) * inv_diag - pu[j]);
+            pu[j] += change;
+            change = change < T(0) ? -change : change;
+            max_change = change > max_change ? change : max_change;
+        }
+    }
+    return max_change;
+}
+
+} // namespace
+
+namespace stencil
+{
+
+const RowKernels<float> &scalar_kernels_float() { return scalar_float; }
+const RowKernels<double> &scalar_kernels_double() { return scalar_double; }
+
+Isa best_isa()
+{
+    if (cpu_supports(Isa::AVX512)) return Isa::AVX512;
+    if (cpu_supports(Isa::AVX2)) return Isa::AVX2;
+    return Isa::Scalar;
+}
+
+Isa active_isa() { return dispatch().isa; }
+
+bool set_isa(Isa isa)
+{
+    if (!cpu_supports(isa)) return false;
+    dispatch() = make_dispatch(isa);
+    return true;
+}
+
+const char *isa_name(Isa isa)
+{
+    switch (isa) {
+    case Isa::Scalar: return "scalar";
+    case Isa::AVX2: return "avx2";
+    case Isa::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+void laplacian(const Field2D<float> &u, Field2D<float> &y, const Box &box, float inv_hx2, float inv_hy2)
+{
+    laplacian_box(u, y, box, inv_hx2, inv_hy2);
+}
+
+void laplacian(const Field2D<double> &u, Field2D<double> &y, const Box &box, double inv_hx2, double inv_hy2)
+{
+    laplacian_box(u, y, box, inv_hx2, inv_hy2);
+}
+
+void residual(const Field2D<float> &u, const Field2D<float> &f, Field2D<float> &r, const Box &box,
+              float inv_hx2, float inv_hy2)
+{
+    residual_box(u, f, r, box, inv_hx2, inv_hy2);
+}
+
+void residual(const Field2D<double> &u, const Field2D<double> &f, Field2D<double> &r, const Box &box,
+              double inv_hx2, double inv_hy2)
+{
+    residual_box(u, f, r, box, inv_hx2, inv_hy2);
+}
+
+float jacobi(const Field2D<float> &u, const Field2D<float> &f, Field2D<float> &u_new, const Box &box,
+             float inv_hx2, float inv_hy2, float omega)
+{
+    return jacobi_box(u, f, u_new, box, inv_hx2, inv_hy2, omega);
+}
+
+double jacobi(const Field2D<double> &u, const Field2D<double> &f, Field2D<double> &u_new, const Box &box,
+              double inv_hx2, double inv_hy2, double omega)
+{
+    return jacobi_box(u, f, u_new, box, inv_hx2, inv_hy2, omega);
+}
+
+float sor(Field2D<float> &u, const Field2D<float> &f, const Box &box, float inv_hx2, float inv_hy2, float omega,
+          int color)
+{
+    return sor_box(u, f, box, inv_hx2, inv_hy2, omega, color);
+}
+
+double sor(Field2D<double> &u, const Field2D<double> &f, const Box &box, double inv_hx2, double inv_hy2, double omega,
+           int color)
+{
+    return sor_box(u, f, box, inv_hx2, inv_hy2, omega, color);
+}
+
+void laplacian(const BatchField2D<float> &u, BatchField2D<float> &y, const Box &box, float inv_hx2, float inv_hy2)
+{
+    laplacian_box(u, y, box, inv_hx2, inv_hy2);
+}
+
+void laplacian(const BatchField2D<double> &u, BatchField2D<double> &y, const Box &box, double inv_hx2,
+               double inv_hy2)
+{
+    laplacian_box(u, y, box, inv_hx2, inv_hy2);
+}
+
+void residual(const BatchField2D<float> &u, const BatchField2D<float> &f, BatchField2D<float> &r, const Box &box,
+              float inv_hx2, float inv_hy2)
+{
+    residual_box(u, f, r, box, inv_hx2, inv_hy2);
+}
+
+void residual(const BatchField2D<double> &u, const BatchField2D<double> &f, BatchField2D<double> &r, const Box &box,
+              double inv_hx2, double inv_hy2)
+{
+    residual_box(u, f, r, box, inv_hx2, inv_hy2);
+}
+
+float jacobi(const BatchField2D<float> &u, const BatchField2D<float> &f, BatchField2D<float> &u_new, const Box &box,
+             float inv_hx2, float inv_hy2, float omega)
+{
+    return jacobi_box(u, f, u_new, box, inv_hx2, inv_hy2, omega);
+}
+
+double jacobi(const BatchField2D<double> &u, const BatchField2D<double> &f, BatchField2D<double> &u_new,
+              const Box &box, double inv_hx2, double inv_hy2, double omega)
+{
+    return jacobi_box(u, f, u_new, box, inv_hx2, inv_hy2, omega);
+}
+
+} // namespace stencil
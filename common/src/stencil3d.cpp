@@ -0,0 +1,124 @@
+#include "stencil3d.hpp"
+#include "parallel.hpp"
+
+namespace
+{
+
+// Neighbouring z-rows of row (i, j) starting at z-index k
+template <typename T>
+struct Rows
+{
+    const T *c, *im, *ip, *jm, *jp;
+
+    Rows(const Field3D<T> &u, int i, int j, int k)
+        : c(u.row(i, j, k)), im(u.row(i - 1, j, k)), ip(u.row(i + 1, j, k)), jm(u.row(i, j - 1, k)), jp(u.row(i, j + 1, k)) {}
+};
+
+template <typename T>
+void laplacian_box(const Field3D<T> &u, Field3D<T> &y, const Box3D &box, T cx, T cy, T cz)
+{
+    if (box.empty()) return;
+    const int n = box.k_end - box.k_begin;
+    const T diag = T(2) * (cx + cy + cz);
+    PDE_OMP(parallel for collapse(2) schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        for (int j = box.j_begin; j < box.j_end; ++j) {
+            const Rows<T> r(u, i, j, box.k_begin);
+            T *out = y.row(i, j, box.k_begin);
+            for (int k = 0; k < n; ++k) {
+                out[k] = diag * r.c[k] - cx * (r.im[k] + r.ip[k]) - cy * (r.jm[k] + r.jp[k]) - cz * (r.c[k - 1] + r.c[k + 1]);
+            }
+        }
+    }
+}
+
+template <typename T>
+void residual_box(const Field3D<T> &u, const Field3D<T> &f, Field3D<T> &res, const Box3D &box, T cx, T cy, T cz)
+{
+    if (box.empty()) return;
+    const int n = box.k_end - box.k_begin;
+    const T diag = T(2) * (cx + cy + cz);
+    PDE_OMP(parallel for collapse(2) schedule(static) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        for (int j = box.j_begin; j < box.j_end; ++j) {
+            const Rows<T> r(u, i, j, box.k_begin);
+            const T *fr = f.row(i, j, box.k_begin);
+            T *out = res.row(i, j, box.k_begin);
+            for (int k = 0; k < n; ++k) {
+                out[k] = fr[k] - (diag * r.c[k] - cx * (r.im[k] + r.ip[k]) - cy * (r.jm[k] + r.jp[k])
+                                  - cz * (r.c[k - 1] + r.c[k + 1]));
+            }
+        }
+    }
+}
+
+template <typename T>
+T jacobi_box(const Field3D<T> &u, const Field3D<T> &f, Field3D<T> &u_new, const Box3D &box, T cx, T cy, T cz, T omega)
+{
+    if (box.empty()) return T(0);
+    const int n = box.k_end - box.k_begin;
+    const T inv_diag = T(1) / (T(2) * (cx + cy + cz));
+    T max_change = T(0);
+    PDE_OMP(parallel for collapse(2) schedule(static) reduction(max:max_change) if(box.count() >= parallel::min_parallel))
+    for (int i = box.i_begin; i < box.i_end; ++i) {
+        for (int j = box.j_begin; j < box.j_end; ++j) {
+            const Rows<T> r(u, i, j, box.k_begin);
+            const T *fr = f.row(i, j, box.k_begin);
+            T *out = u_new.row(i, j, box.k_begin);
+            T m = T(0);
+            for (int k = 0; k < n; ++k) {
+                T gs = (fr[k] + cx * (r.im[k] + r.ip[k]) + cy * (r.jm[k] + r.jp[k]) + cz * (r.c[k - 1] + r.c[k + 1])) * inv_diag;
+                T v = (T(1) - omega) * r.c[k] + omega * gs;
+                T d = v - r.c[k];
+                d = d < T(0) ? -d : d;
+                m = d > m ? d : m;
+                out[k] = v;
+            }
+            max_change = m > max_change ? m : max_change;
+        }
+    }
+    return max_change;
+}
+
+} // namespace
+
+namespace stencil
+{
+
+void laplacian(const Field3D<float> &u, Field3D<float> &y, const Box3D &box,
+               float inv_hx2, float inv_hy2, float inv_hz2)
+{
+    laplacian_box(u, y, box, inv_hx2, inv_hy2, inv_hz2);
+}
+
+void laplacian(const Field3D<double> &u, Field3D<double> &y, const Box3D &box,
+               double inv_hx2, double inv_hy2, double inv_hz2)
+{
+    laplacian_box(u, y, box, inv_hx2, inv_hy2, inv_hz2);
+}
+
+void residual(const Field3D<float> &u, const Field3D<float> &f, Field3D<float> &r, const Box3D &box,
+              float inv_hx2, float inv_hy2, float inv_hz2)
+{
+    residual_box(u, f, r, box, inv_hx2, inv_hy2, inv_hz2);
+}
+
+void residual(const Field3D<double> &u, const Field3D<double> &f, Field3D<double> &r, const Box3D &box,
+              double inv_hx2, double inv_hy2, double inv_hz2)
+{
+    residual_box(u, f, r, box, inv_hx2, inv_hy2, inv_hz2);
+}
+
+float jacobi(const Field3D<float> &u, const Field3D<float> &f, Field3D<float> &u_new, const Box3D &box,
+             float inv_hx2, float inv_hy2, float inv_hz2, float omega)
+{
+    return jacobi_box(u, f, u_new, box, inv_hx2, inv_hy2, inv_hz2, omega);
+}
+
+double jacobi(const Field3D<double> &u, const Field3D<double> &f, Field3D<double> &u_new, const Box3D &box,
+              double inv_hx2, double inv_hy2, double inv_hz2, double omega)
+{
+    return jacobi_box(u, f, u_new, box, inv_hx2, inv_hy2, inv_hz2, omega);
+}
+
+} // namespace stencil
@@ -0,0 +1,61 @@
+// AVX2 row kernels, this file is compiled with -mavx2 (see CMakeLists.txt)
+#include <immintrin.h>
+#define PDE_STENCIL_ROW_TEMPLATES
+#include "stencil_rows.hpp"
+
+namespace
+{
+
+struct Avx2Float
+{
+    using T = float;
+    using reg = __m256;
+    static constexpr int width = 8;
+    static reg set1(T x) { return _mm256_set1_ps(x); }
+    static reg zero() { return _mm256_setzero_ps(); }
+    static reg load(const T *p) { return _mm256_loadu_ps(p); }
+    static void store(T *p, reg a) { _mm256_storeu_ps(p, a); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg abs(reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+    static T hmax(reg a) {
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+};
+
+struct Avx2Double
+{
+    using T = double;
+    using reg = __m256d;
+    static constexpr int width = 4;
+    static reg set1(T x) { return _mm256_set1_pd(x); }
+    static reg zero() { return _mm256_setzero_pd(); }
+    static reg load(const T *p) { return _mm256_loadu_pd(p); }
+    static void store(T *p, reg a) { _mm256_storeu_pd(p, a); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg abs(reg a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+    static T hmax(reg a) {
+        __m128d m = _mm_max_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        m = _mm_max_sd(m, _mm_unpackhi_pd(m, m));
+        return _mm_cvtsd_f64(m);
+    }
+};
+
+const stencil::RowKernels<float> kernels_float = make_row_kernels<Avx2Float>();
+const stencil::RowKernels<double> kernels_double = make_row_kernels<Avx2Double>();
+
+} // namespace
+
+namespace stencil
+{
+const RowKernels<float> &avx2_kernels_float() { return kernels_float; }
+const RowKernels<double> &avx2_kernels_double() { return kernels_double; }
+} // namespace stencil
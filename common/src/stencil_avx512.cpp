@@ -0,0 +1,70 @@
+// AVX-512 row kernels, this file is compiled with -mavx512f (see CMakeLists.txt)
+#include <immintrin.h>
+#define PDE_STENCIL_ROW_TEMPLATES
+#include "stencil_rows.hpp"
+
+namespace
+{
+
+// Horizontal maximum through memory; called once per row, so speed does not matter. (The
+// _mm512_reduce_* / _mm512_max_* intrinsics built on _mm512_undefined_* trip -Wuninitialized
+// in GCC 12, hence also the maskz forms below.)
+template <typename T, int width, typename R>
+T reduce_max(R a)
+{
+    T lanes[width];
+    static_assert(sizeof(lanes) == sizeof(R), "lane count does not match the register");
+    __builtin_memcpy(lanes, &a, sizeof(lanes));
+    T m = lanes[0];
+    for (int k = 1; k < width; ++k) m = lanes[k] > m ? lanes[k] : m;
+    return m;
+}
+
+struct Avx512Float
+{
+    using T = float;
+    using reg = __m512;
+    static constexpr int width = 16;
+    static reg set1(T x) { return _mm512_set1_ps(x); }
+    static reg zero() { return _mm512_setzero_ps(); }
+    static reg load(const T *p) { return _mm512_loadu_ps(p); }
+    static void store(T *p, reg a) { _mm512_storeu_ps(p, a); }
+    static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+    static reg abs(reg a) {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff)));
+    }
+    static reg max(reg a, reg b) { return _mm512_maskz_max_ps(0xFFFF, a, b); }
+    static T hmax(reg a) { return reduce_max<T, width>(a); }
+};
+
+struct Avx512Double
+{
+    using T = double;
+    using reg = __m512d;
+    static constexpr int width = 8;
+    static reg set1(T x) { return _mm512_set1_pd(x); }
+    static reg zero() { return _mm512_setzero_pd(); }
+    static reg load(const T *p) { return _mm512_loadu_pd(p); }
+    static void store(T *p, reg a) { _mm512_storeu_pd(p, a); }
+    static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+    static reg abs(reg a) {
+        return _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a), _mm512_set1_epi64(0x7fffffffffffffffLL)));
+    }
+    static reg max(reg a, reg b) { return _mm512_maskz_max_pd(0xFF, a, b); }
+    static T hmax(reg a) { return reduce_max<T, width>(a); }
+};
+
+const stencil::RowKernels<float> kernels_float = make_row_kernels<Avx512Float>();
+const stencil::RowKernels<double> kernels_double = make_row_kernels<Avx512Double>();
+
+} // namespace
+
+namespace stencil
+{
+const RowKernels<float> &avx512_kernels_float() { return kernels_float; }
+const RowKernels<double> &avx512_kernels_double() { return kernels_double; }
+} // namespace stencil
@@ -0,0 +1,120 @@
+#pragma once
+// Row kernels of the 5-point stencil, written once against a small SIMD abstraction V and
+// instantiated per instruction set (see stencil.cpp, stencil_avx2.cpp, stencil_avx512.cpp).
+//
+// V provides: T, reg, width, set1, zero, load (unaligned), store (unaligned), add, sub, mul,
+// abs, max and hmax. Each lane performs exactly the operations of the scalar tail loop, so
+// all instruction sets give bitwise identical results.
+//
+// Row pointers: c points to u(i, j_begin); x-neighbours are cl = u(i-1, .), cr = u(i+1, .);
+// y-neighbours are c[j-dy] and c[j+dy], dy = 1 for a Field2D and B for the interleaved rows
+// of a BatchField2D (n then counts the values of all members).
+
+namespace stencil
+{
+
+// Function table of one instruction set for scalar type T
+template <typename T>
+struct RowKernels
+{
+    void (*laplacian)(const T *c, const T *cl, const T *cr, T *y, int n, int dy, T cx, T cy);
+    void (*residual)(const T *c, const T *cl, const T *cr, const T *f, T *r, int n, int dy, T cx, T cy);
+    T (*jacobi)(const T *c, const T *cl, const T *cr, const T *f, T *u_new, int n, int dy, T cx, T cy,
+                T inv_diag, T omega);
+};
+
+const RowKernels<float> &scalar_kernels_float();
+const RowKernels<double> &scalar_kernels_double();
+#ifdef PDE_STENCIL_AVX2
+const RowKernels<float> &avx2_kernels_float();
+const RowKernels<double> &avx2_kernels_double();
+#endif
+#ifdef PDE_STENCIL_AVX512
+const RowKernels<float> &avx512_kernels_float();
+const RowKernels<double> &avx512_kernels_double();
+#endif
+
+} // namespace stencil
+
+// The templates below are only meant to be instantiated inside an anonymous namespace of
+// one of the kernel translation units (they are compiled with different -m flags).
+#ifdef PDE_STENCIL_ROW_TEMPLATES
+
+template <class V>
+void laplacian_row(const typename V::T *c, const typename V::T *cl, const typename V::T *cr,
+                   typename V::T *y, int n, int dy, typename V::T cx, typename V::T cy)
+{
+    using T = typename V::T;
+    const auto vcx = V::set1(cx), vcy = V::set1(cy);
+    int j = 0;
+    for (; j + V::width <= n; j += V::width) {
+        auto u = V::load(c + j);
+        auto u2 = V::add(u, u);
+        auto ax = V::mul(V::sub(V::sub(u2, V::load(cl + j)), V::load(cr + j)), vcx);
+        auto ay = V::mul(V::sub(V::sub(u2, V::load(c + j - dy)), V::load(c + j + dy)), vcy);
+        V::store(y + j, V::add(ax, ay));
+    }
+    for (; j < n; ++j) {
+        T u2 = c[j] + c[j];
+        y[j] = (u2 - cl[j] - cr[j]) * cx + (u2 - c[j - dy] - c[j + dy]) * cy;
+    }
+}
+
+template <class V>
+void residual_row(const typename V::T *c, const typename V::T *cl, const typename V::T *cr,
+                  const typename V::T *f, typename V::T *r, int n, int dy, typename V::T cx, typename V::T cy)
+{
+    using T = typename V::T;
+    const auto vcx = V::set1(cx), vcy = V::set1(cy);
+    int j = 0;
+    for (; j + V::width <= n; j += V::width) {
+        auto u = V::load(c + j);
+        auto u2 = V::add(u, u);
+        auto ax = V::mul(V::sub(V::sub(u2, V::load(cl + j)), V::load(cr + j)), vcx);
+        auto ay = V::mul(V::sub(V::sub(u2, V::load(c + j - dy)), V::load(c + j + dy)), vcy);
+        V::store(r + j, V::sub(V::load(f + j), V::add(ax, ay)));
+    }
+    for (; j < n; ++j) {
+        T u2 = c[j] + c[j];
+        r[j] = f[j] - ((u2 - cl[j] - cr[j]) * cx + (u2 - c[j - dy] - c[j + dy]) * cy);
+    }
+}
+
+template <class V>
+typename V::T jacobi_row(const typename V::T *c, const typename V::T *cl, const typename V::T *cr,
+                         const typename V::T *f, typename V::T *u_new, int n, int dy, typename V::T cx,
+                         typename V::T cy, typename V::T inv_diag, typename V::T omega)
+{
+    using T = typename V::T;
+    const T keep = T(1) - omega;
+    const auto vcx = V::set1(cx), vcy = V::set1(cy), vinv = V::set1(inv_diag);
+    const auto vomega = V::set1(omega), vkeep = V::set1(keep);
+    auto vmax = V::zero();
+    int j = 0;
+    for (; j + V::width <= n; j += V::width) {
+        auto u = V::load(c + j);
+        auto sx = V::mul(V::add(V::load(cl + j), V::load(cr + j)), vcx);
+        auto sy = V::mul(V::add(V::load(c + j - dy), V::load(c + j + dy)), vcy);
+        auto gs = V::mul(V::add(V::add(sx, sy), V::load(f + j)), vinv);
+        auto un = V::add(V::mul(vkeep, u), V::mul(vomega, gs));
+        V::store(u_new + j, un);
+        vmax = V::max(vmax, V::abs(V::sub(un, u)));
+    }
+    T m = V::hmax(vmax);
+    for (; j < n; ++j) {
+        T gs = ((cl[j] + cr[j]) * cx + (c[j - dy] + c[j + dy]) * cy + f[j]) * inv_diag;
+        T un = keep * c[j] + omega * gs;
+        u_new[j] = un;
+        T d = un > c[j] ? un - c[j] : c[j] - un;
+        m = d > m ? d : m;
+    }
+    return m;
+}
+
+template <class V>
+stencil::RowKernels<typename V::T> make_row_kernels()
+{
+    return {&laplacian_row<V>, &residual_row<V>, &jacobi_row<V>};
+}
+
+#endif // PDE_STENCIL_ROW_TEMPLATES
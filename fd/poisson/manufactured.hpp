@@ -0,0 +1,70 @@
+#pragma once
+#include <mpi.h>
+#include <cmath>
+#include <algorithm>
+#include "decomp2d.hpp"
+#include "field2d.hpp"
+
+// Manufactured test problem on the unit square:
+//   -Laplacian u = 2 pi^2 sin(pi x) sin(pi y),  u = 0 on the boundary,
+// with exact solution u = sin(pi x) sin(pi y). Grid point (gi, gj) sits at (gi * hx, gj * hy).
+// Sampled on the grid this right-hand side is an eigenvector of the discrete operator, so a
+// Krylov solver converges in one iteration: it checks the discretisation, not the solver. The
+// polynomial problems below excite the whole spectrum.
+namespace manufactured
+{
+
+template <typename T>
+void fill_rhs(Field2D<T> &f, double hx, double hy) {
+  for(int i = 0; i < f.nx(); ++i) {
+    for(int j = 0; j < f.ny(); ++j) {
+      double x = f.global_i(i) * hx;
+      double y = f.global_j(j) * hy;
+      f(i, j) = static_cast<T>(2.0 * M_PI * M_PI * std::sin(M_PI * x) * std::sin(M_PI * y));
+    }
+  }
+}
+
+inline double exact(double x, double y) { return std::sin(M_PI * x) * std::sin(M_PI * y); }
+
+// A family of polynomial problems (the members of a batched solve): for a >= 1
+//   u = x^a (1 - x) y (1 - y),  -Laplacian u = (a (a + 1) x^(a-1) - a (a - 1) x^(a-2)) y (1 - y) + 2 x^a (1 - x)
+inline double exact_poly(double x, double y, int a) { return std::pow(x, a) * (1.0 - x) * y * (1.0 - y); }
+
+template <typename T>
+void fill_rhs_poly(Field2D<T> &f, double hx, double hy, int a) {
+  for(int i = 0; i < f.nx(); ++i) {
+    for(int j = 0; j < f.ny(); ++j) {
+      double x = f.global_i(i) * hx;
+      double y = f.global_j(j) * hy;
+      double uxx = a * (a + 1) * std::pow(x, a - 1) - (a > 1 ? a * (a - 1) * std::pow(x, a - 2) : 0.0);
+      f(i, j) = static_cast<T>(uxx * y * (1.0 - y) + 2.0 * std::pow(x, a) * (1.0 - x));
+    }
+  }
+}
+
+struct ErrorNorms { double l2, linf; };
+
+// Discrete L2 (scaled by the cell area) and L-infinity norms of u - exact_fn over all ranks
+template <typename T, typename Exact>
+ErrorNorms errors(const Field2D<T> &u, double hx, double hy, MPI_Comm comm, Exact exact_fn) {
+  double local[2] = {0.0, 0.0}; // sum of squares, max
+  for(int i = 0; i < u.nx(); ++i) {
+    for(int j = 0; j < u.ny(); ++j) {
+      double e = std::abs(static_cast<double>(u(i, j)) - exact_fn(u.global_i(i) * hx, u.global_j(j) * hy));
+      local[0] += e * e;
+      local[1] = std::max(local[1], e);
+    }
+  }
+  double l2 = 0.0, linf = 0.0;
+  MPI_Allreduce(&local[0], &l2, 1, MPI_DOUBLE, MPI_SUM, comm);
+  MPI_Allreduce(&local[1], &linf, 1, MPI_DOUBLE, MPI_MAX, comm);
+  return {std::sqrt(l2 * hx * hy), linf};
+}
+
+template <typename T>
+ErrorNorms errors(const Field2D<T> &u, double hx, double hy, MPI_Comm comm) {
+  return errors(u, hx, hy, comm, exact);
+}
+
+} // namespace manufactured
@@ -1,23 +1,430 @@
 #include <mpi.h>
 #include <cstdio>
 #include <cmath>
+#include <algorithm>
+#include <memory>
+#include <string>
 #include "decomp2d.hpp"
+#include "field2d.hpp"
+#include "fieldIO.hpp"
+#include "fieldOps.hpp"
+#include "poisson2d.hpp"
+#include "preconditioners.hpp"
+#include "cg.hpp"
+#include "batchCG.hpp"
+#include "pipelinedCG.hpp"
+#include "multigrid.hpp"
+#include "chebyshev.hpp"
+#include "fastPoisson.hpp"
+#include "refinement.hpp"
+#include "manufactured.hpp"
+#include "config.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
+// Usage: poisson_fd [--key=value ...] [--config=file]
+//        poisson_fd [n] [precond] [cycle] [precision]          (positional form of the same keys)
+// Solves a manufactured Poisson problem on an nx x ny grid with preconditioned CG, with
+// multigrid cycles alone (solver=multigrid) or with Chebyshev-accelerated Jacobi
+// (solver=chebyshev, no reductions between its residual checks). solver=pipecg is CG with one
+// non-blocking reduction per iteration, overlapped with the preconditioner and the matrix-vector
+// product. solver=fft solves directly with sine transforms (fastPoisson.hpp). Options (see
+// config.hpp for the syntax):
+//   n=129, nx=n, ny=n       global grid; multigrid coarsens while N - 1 is even (2^k + 1 is best)
+//   px=0, py=0              process grid, 0 picks it from the rank count
+//   halo=packed|datatype    halo exchange of the fine-grid operator
+//   problem=poly|sine       poly: u = x^3 (1 - x) y (1 - y), whose right-hand side excites all modes;
+//                           sine: u = sin(pi x) sin(pi y), a discrete eigenvector (one CG iteration),
+//                           only an accuracy check of the discretisation
+//   solver=cg|pipecg|multigrid|chebyshev|fft  (precond=multigrid is accepted for solver=multigrid)
+//   precond=none|jacobi|ssor|mg|chebyshev, ssor_omega=1.5, cycle=V|W|F, smooth=2 (pre- and post-sweeps)
+//   smoother=jacobi|rbgs|chebyshev  multigrid smoother, rbgs: red-black Gauss-Seidel
+//   cheb_degree=4, cheb_estimate=0  Chebyshev preconditioner degree, Lanczos steps of the bound estimate
+//                           (0: the exact bounds of D^-1 A, stencil::jacobi_spectrum)
+//   cheb_lower=0            lower spectral bound of D^-1 A for the Chebyshev solver (0: the bound above)
+//   check_interval=50       Chebyshev solver: steps between residual checks
+//   replace_interval=100    pipecg: iterations between residual replacements (0: never)
+//   precision=double|float|mixed   mixed: float solver inside double iterative refinement
+//   rtol=1e-10 (in float 2e-8 N^2, the rounding floor; chebyshev: times sqrt(N) / 4), max_iter, inner_rtol=1e-3, inner_max_iter (mixed), verbose
+//   batch=0                 B > 0: solve B problems at once with batched CG (batchCG.hpp), member b
+//                           the polynomial problem a = b + 1 of manufactured.hpp; solver=cg, double only, with
+//                           precond=none or jacobi (the same iterates: the diagonal of A is constant)
+//   output=<file>           write the solution (raw format of fieldIO.hpp, or HDF5 with output_format)
+//   output_format=auto|raw|hdf5   auto: HDF5 for .h5 and .hdf5 files (needs ENABLE_HDF5), raw otherwise
+//   print_config            print the options used, as a config file
+
+struct SolverOptions {
+  std::string precond;
+  char cycle;
+  int smooth;
+  MGSmoother smoother;
+  double ssor_omega;
+  int cheb_degree;
+  int cheb_estimate;
+  double cheb_lower;
+};
+
+// Multigrid on A with the cycle type given by its letter; rank 0 describes the hierarchy
+template <typename T>
+std::unique_ptr<Multigrid<T>> make_multigrid(const Poisson2D<T> &A, const SolverOptions &opt) {
+  auto mg = std::make_unique<Multigrid<T>>(A);
+  if (opt.cycle == 'W') mg->cycle_type = MGCycle::W;
+  else if (opt.cycle == 'F') mg->cycle_type = MGCycle::F;
+  mg->pre_smooth = mg->post_smooth = opt.smooth;
+  mg->smoother = opt.smoother;
+  if (A.decomp().rank() == 0) {
+    const char *smoother = opt.smoother == MGSmoother::RedBlack ? "red-black Gauss-Seidel"
+                           : opt.smoother == MGSmoother::Chebyshev ? "Chebyshev" : "Jacobi";
+    std::printf("Multigrid: %d levels, coarsest %d x %d, %c-cycle, %s smoother", mg->num_levels(),
+                mg->level_decomp(mg->num_levels() - 1).Nx(), mg->level_decomp(mg->num_levels() - 1).Ny(), opt.cycle,
+                smoother);
+    if (mg->agglomeration_level() >= 0) std::printf(", agglomerated below level %d", mg->agglomeration_level());
+    std::printf("\n");
+  }
+  return mg;
+}
+
+// Chebyshev iteration with the exact or estimated spectral bounds; rank 0 reports them
+template <typename T>
+std::unique_ptr<Chebyshev<T>> make_chebyshev(Poisson2D<T> &A, const SolverOptions &opt) {
+  auto cheb = std::make_unique<Chebyshev<T>>(A, opt.cheb_estimate);
+  cheb->degree = opt.cheb_degree;
+  if (opt.cheb_lower > 0.0) cheb->set_interval(opt.cheb_lower, cheb->upper());
+  if (A.decomp().rank() == 0) {
+    std::printf("Chebyshev: spectrum of D^-1 A %s [%.6e, %.6e], interval [%.6e, %.6e]\n",
+                opt.cheb_estimate > 0 ? "estimated in" : "is", cheb->lambda_min(), cheb->lambda_max(), cheb->lower(),
+                cheb->upper());
+  }
+  return cheb;
+}
+
+// Jacobi, SSOR or Chebyshev preconditioner, nullptr for none and multigrid
+template <typename T>
+std::unique_ptr<Preconditioner<T>> make_preconditioner(Poisson2D<T> &A, const SolverOptions &opt) {
+  if (opt.precond == "jacobi") return std::make_unique<JacobiPreconditioner<T>>(A);
+  if (opt.precond == "ssor") return std::make_unique<SSORPreconditioner<T>>(A, static_cast<T>(opt.ssor_omega));
+  if (opt.precond == "chebyshev") return make_chebyshev(A, opt);
+  return nullptr;
+}
+
+// batch=B: B manufactured problems in one BatchCGSolver, then the same problems one after
+// another with CGSolver for comparison of the time
+void run_batch(const Decomp2D &decomp, HaloMode halo, int batch, double rtol, int max_iter, int verbose) {
+  const int rank = decomp.rank();
+  const double hx = 1.0 / (decomp.Nx() - 1);
+  const double hy = 1.0 / (decomp.Ny() - 1);
+
+  BatchPoisson2D<double> A(decomp, hx, hy, batch, halo);
+  BatchField2D<double> u(decomp, batch), f(decomp, batch);
+  Field2D<double> member(decomp);
+  for (int b = 0; b < batch; ++b) {
+    manufactured::fill_rhs_poly(member, hx, hy, b + 1);
+    f.set_member(b, member);
+  }
+  BatchCGSolver<double> cg(A);
+  cg.rtol = rtol;
+  cg.max_iter = max_iter;
+  cg.verbose = verbose;
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  double t0 = MPI_Wtime();
+  SolveStats stats = cg.solve(f, u);
+  double elapsed = MPI_Wtime() - t0;
+  if (rank == 0) {
+    std::printf("Batched CG (no preconditioner, %d members): %s after %d iterations, largest relative residual = %e, time = %.3f s\n",
+                batch, stats.converged ? "converged" : "NOT converged", stats.iterations, stats.residual, elapsed);
+  }
+  for (int b = 0; b < batch; ++b) {
+    u.get_member(b, member);
+    manufactured::ErrorNorms err = manufactured::errors(member, hx, hy, MPI_COMM_WORLD, [b](double x, double y) {
+      return manufactured::exact_poly(x, y, b + 1);
+    });
+    if (rank == 0) {
+      std::printf("  member %d: %d iterations, relative residual = %e, L2 error = %e, L-infinity error = %e\n",
+                  b, cg.iterations(b), cg.residual(b), err.l2, err.linf);
+    }
+  }
+
+  // the same problems one at a time
+  Poisson2D<double> A1(decomp, hx, hy, halo);
+  CGSolver<double> cg1(A1);
+  cg1.rtol = rtol;
+  cg1.max_iter = max_iter;
+  Field2D<double> u1(decomp), f1(decomp);
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  int iterations = 0;
+  for (int b = 0; b < batch; ++b) {
+    u1.fill(0.0);
+    manufactured::fill_rhs_poly(f1, hx, hy, b + 1);
+    iterations += cg1.solve(f1, u1).iterations;
+  }
+  double sequential = MPI_Wtime() - t0;
+  if (rank == 0) {
+    std::printf("Sequential CG (no preconditioner, %d solves): %d iterations in total, time = %.3f s (batched: %.2fx)\n",
+                batch, iterations, sequential, sequential / elapsed);
+  }
+}
 
 int main(int argc, char** argv) {
-  MPI_Init(&argc, &argv);
+  parallel::init_mpi(&argc, &argv);
 
   int rank, size;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-  //std::printf("poisson_fd built with MPI. ranks=%d/size=%d\n", rank, size);
+  Config config(argc, argv, MPI_COMM_WORLD, {"n", "precond", "cycle", "precision"});
+  const int N = config.get_int("n", 129);
+  const int Nx = config.get_int("nx", N), Ny = config.get_int("ny", N);
+  const int Px = config.get_int("px", 0), Py = config.get_int("py", 0);
+  const HaloMode halo = config.get_choice("halo", "packed", {"packed", "datatype"}) == "datatype"
+                            ? HaloMode::Datatype : HaloMode::Packed;
+  const std::string problem = config.get_choice("problem", "poly", {"poly", "sine"});
+  std::string solver = config.get_choice("solver", "cg", {"cg", "pipecg", "multigrid", "chebyshev", "fft"});
+  SolverOptions opt;
+  opt.precond = config.get_choice("precond", "jacobi", {"none", "jacobi", "ssor", "mg", "multigrid", "chebyshev"});
+  if (opt.precond == "multigrid") { // the old positional spelling of solver=multigrid
+    solver = "multigrid";
+    opt.precond = "none";
+  }
+  opt.cycle = config.get_choice("cycle", "V", {"V", "W", "F"})[0];
+  opt.smooth = config.get_int("smooth", 2);
+  const std::string smoother = config.get_choice("smoother", "jacobi", {"jacobi", "rbgs", "chebyshev"});
+  opt.smoother = smoother == "rbgs" ? MGSmoother::RedBlack
+                 : smoother == "chebyshev" ? MGSmoother::Chebyshev : MGSmoother::Jacobi;
+  opt.ssor_omega = config.get_double("ssor_omega", 1.5);
+  opt.cheb_degree = config.get_int("cheb_degree", 4);
+  opt.cheb_estimate = config.get_int("cheb_estimate", 0);
+  opt.cheb_lower = config.get_double("cheb_lower", 0.0);
+  const std::string precision = config.get_choice("precision", "double", {"double", "float", "mixed"});
+  // a float residual bottoms out near epsilon * cond(A), which grows like N^2 (about 7e-4 at
+  // N = 257), so the float default stays just above that floor. Chebyshev's floor is higher
+  // and grows like another sqrt(N) (1.6x / 2.4x / 3.6x at N = 129 / 257 / 513): with the exact
+  // spectral bounds the rounding noise of each step decays only over about sqrt(cond) steps
+  const double float_floor = 2e-8 * std::max(Nx, Ny) * std::max(Nx, Ny) *
+                             (solver == "chebyshev" ? std::max(1.0, 0.25 * std::sqrt(std::max(Nx, Ny))) : 1.0);
+  const double rtol = config.get_double("rtol", precision == "float" ? std::max(1e-5, float_floor) : 1e-10);
+  const int max_iter = config.get_int("max_iter", solver == "multigrid" ? 50 : solver == "chebyshev" ? 100000 : 10000);
+  // each refinement step gains about three digits; much tighter inner tolerances run into
+  // the float rounding of the inner residual (about epsilon * cond(A))
+  const double inner_rtol = config.get_double("inner_rtol", 1e-3);
+  // on fine grids the first correction may not reach inner_rtol in float multigrid
+  const int inner_max_iter = config.get_int("inner_max_iter", solver == "multigrid" ? 10 : 10000);
+  const int verbose = config.get_int("verbose", solver == "multigrid" ? 1 : 100);
+  const int check_interval = config.get_int("check_interval", 50);
+  const int replace_interval = config.get_int("replace_interval", 100);
+  const int batch = config.get_int("batch", 0);
+  const std::string output = config.get("output", "");
+  const std::string output_format = config.get_choice("output_format", "auto", {"auto", "raw", "hdf5"});
+  const bool print_config = config.get_bool("print_config", false);
+  config.check_unused();
+  if (print_config) config.print();
+
+  const bool mg_solver = solver == "multigrid";
+  const bool cheb_solver = solver == "chebyshev";
+  const bool pipe_solver = solver == "pipecg";
+  const bool fft_solver = solver == "fft";
+  const bool use_mg = mg_solver || opt.precond == "mg";
+  const bool mixed = precision == "mixed";
+  const bool low = precision != "double"; // the solvers run in float
 
-  Decomp2D decomp(MPI_COMM_WORLD, 100, 100, 1, 3); // Example: global grid 100x100, process grid sqrt(size) x sqrt(size)
+  Decomp2D decomp = (Px > 0 && Py > 0) ? Decomp2D(MPI_COMM_WORLD, Nx, Ny, Px, Py, 1)
+                                       : Decomp2D::create(MPI_COMM_WORLD, Nx, Ny, 1);
 
+  if (rank == 0) std::printf("%d MPI ranks x %d OpenMP threads\n", size, parallel::max_threads());
   std::printf("Rank %d: local grid bounds i=[%d, %d), j=[%d, %d), px=%d, py=%d, neighbors (left=%d, right=%d, up=%d, down=%d)\n",
               decomp.rank(), decomp.i0(), decomp.i1(), decomp.j0(), decomp.j1(),
               decomp.px(), decomp.py(), decomp.left(), decomp.right(), decomp.up(), decomp.down());
 
+  if (batch > 0) {
+    if (solver != "cg" || (opt.precond != "none" && opt.precond != "jacobi") || precision != "double") {
+      if (rank == 0) {
+        std::fprintf(stderr, "Error: batch=%d needs solver=cg, precond=none|jacobi and precision=double\n", batch);
+      }
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    run_batch(decomp, halo, batch, rtol, max_iter, verbose);
+    profiler::finish(MPI_COMM_WORLD);
+    MPI_Finalize();
+    return 0;
+  }
+
+  const double hx = 1.0 / (decomp.Nx() - 1);
+  const double hy = 1.0 / (decomp.Ny() - 1);
+
+  Poisson2D<double> A(decomp, hx, hy, halo);
+  Field2D<double> u(decomp), f(decomp);
+  const bool sine = problem == "sine";
+  const int degree = 3; // of the polynomial problem in x
+  if (sine) manufactured::fill_rhs(f, hx, hy);
+  else manufactured::fill_rhs_poly(f, hx, hy, degree);
+
+  // double solvers, or float solvers for float and the inner iterations of mixed precision
+  Poisson2D<float> A_lo(decomp, hx, hy, halo);
+  std::unique_ptr<Multigrid<double>> mg;
+  std::unique_ptr<Multigrid<float>> mg_lo;
+  std::unique_ptr<Preconditioner<double>> M;
+  std::unique_ptr<Preconditioner<float>> M_lo;
+  std::unique_ptr<Chebyshev<double>> cheb;
+  std::unique_ptr<Chebyshev<float>> cheb_lo;
+  std::unique_ptr<FastPoisson<double>> fast;
+  std::unique_ptr<FastPoisson<float>> fast_lo;
+  if (low) {
+    if (use_mg) mg_lo = make_multigrid(A_lo, opt);
+    if (cheb_solver) cheb_lo = make_chebyshev(A_lo, opt);
+    if (fft_solver) fast_lo = std::make_unique<FastPoisson<float>>(A_lo);
+    M_lo = make_preconditioner(A_lo, opt);
+  }
+  else {
+    if (use_mg) mg = make_multigrid(A, opt);
+    if (cheb_solver) cheb = make_chebyshev(A, opt);
+    if (fft_solver) fast = std::make_unique<FastPoisson<double>>(A);
+    M = make_preconditioner(A, opt);
+  }
+  if (fft_solver && rank == 0) std::printf("Fast Poisson solver: sine transforms by the %s\n", fft::backend());
+
+  CGSolver<double> cg(A, opt.precond == "mg" ? mg.get() : M.get());
+  cg.rtol = rtol;
+  cg.max_iter = max_iter;
+  cg.verbose = verbose;
+
+  CGSolver<float> cg_lo(A_lo, opt.precond == "mg" ? mg_lo.get() : M_lo.get());
+  cg_lo.rtol = mixed ? inner_rtol : rtol;
+  cg_lo.max_iter = mixed ? inner_max_iter : max_iter;
+  cg_lo.verbose = mixed ? 0 : verbose;
+
+  // the pipelined variant with the same preconditioner and limits
+  std::unique_ptr<PipelinedCGSolver<double>> pcg;
+  std::unique_ptr<PipelinedCGSolver<float>> pcg_lo;
+  if (pipe_solver && low) {
+    pcg_lo = std::make_unique<PipelinedCGSolver<float>>(A_lo, opt.precond == "mg" ? mg_lo.get() : M_lo.get());
+    pcg_lo->rtol = cg_lo.rtol;
+    pcg_lo->max_iter = cg_lo.max_iter;
+    pcg_lo->verbose = cg_lo.verbose;
+    pcg_lo->replace_interval = replace_interval;
+  }
+  else if (pipe_solver) {
+    pcg = std::make_unique<PipelinedCGSolver<double>>(A, opt.precond == "mg" ? mg.get() : M.get());
+    pcg->rtol = rtol;
+    pcg->max_iter = max_iter;
+    pcg->verbose = verbose;
+    pcg->replace_interval = replace_interval;
+  }
+  if (mg_lo) {
+    mg_lo->rtol = cg_lo.rtol;
+    mg_lo->max_iter = cg_lo.max_iter;
+    mg_lo->verbose = cg_lo.verbose;
+  }
+  if (mg) {
+    mg->rtol = rtol;
+    mg->max_iter = max_iter;
+    mg->verbose = verbose;
+  }
+  if (cheb_lo) {
+    cheb_lo->rtol = cg_lo.rtol;
+    cheb_lo->max_iter = cg_lo.max_iter;
+    cheb_lo->verbose = cg_lo.verbose;
+    cheb_lo->check_interval = check_interval;
+  }
+  if (cheb) {
+    cheb->rtol = rtol;
+    cheb->max_iter = max_iter;
+    cheb->verbose = verbose;
+    cheb->check_interval = check_interval;
+  }
+  if (fast_lo) fast_lo->rtol = cg_lo.rtol;
+  if (fast) fast->rtol = rtol;
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  double t0 = MPI_Wtime();
+  SolveStats stats;
+  int inner_iterations = 0;
+  if (mixed && mg_solver) {
+    IterativeRefinement<Multigrid<float>> refine_mg(A, *mg_lo);
+    refine_mg.rtol = rtol;
+    refine_mg.verbose = 1;
+    stats = refine_mg.solve(f, u);
+    inner_iterations = refine_mg.inner_iterations();
+  }
+  else if (mixed && cheb_solver) {
+    IterativeRefinement<Chebyshev<float>> refine_cheb(A, *cheb_lo);
+    refine_cheb.rtol = rtol;
+    refine_cheb.verbose = 1;
+    stats = refine_cheb.solve(f, u);
+    inner_iterations = refine_cheb.inner_iterations();
+  }
+  else if (mixed && pipe_solver) {
+    IterativeRefinement<PipelinedCGSolver<float>> refine_pcg(A, *pcg_lo);
+    refine_pcg.rtol = rtol;
+    refine_pcg.verbose = 1;
+    stats = refine_pcg.solve(f, u);
+    inner_iterations = refine_pcg.inner_iterations();
+  }
+  else if (mixed && fft_solver) {
+    IterativeRefinement<FastPoisson<float>> refine_fft(A, *fast_lo);
+    refine_fft.rtol = rtol;
+    refine_fft.verbose = 1;
+    stats = refine_fft.solve(f, u);
+    inner_iterations = refine_fft.inner_iterations();
+  }
+  else if (mixed) {
+    IterativeRefinement<CGSolver<float>> refine_cg(A, cg_lo);
+    refine_cg.rtol = rtol;
+    refine_cg.verbose = 1;
+    stats = refine_cg.solve(f, u);
+    inner_iterations = refine_cg.inner_iterations();
+  }
+  else if (low) {
+    Field2D<float> u_lo(decomp), f_lo(decomp);
+    fieldops::convert(f, f_lo, A.box());
+    stats = mg_solver ? mg_lo->solve(f_lo, u_lo) : cheb_solver ? cheb_lo->solve(f_lo, u_lo)
+            : pipe_solver ? pcg_lo->solve(f_lo, u_lo) : fft_solver ? fast_lo->solve(f_lo, u_lo)
+            : cg_lo.solve(f_lo, u_lo);
+    fieldops::convert(u_lo, u, A.box());
+  }
+  else if (mg_solver) {
+    stats = mg->solve(f, u);
+  }
+  else if (cheb_solver) {
+    stats = cheb->solve(f, u);
+  }
+  else if (pipe_solver) {
+    stats = pcg->solve(f, u);
+  }
+  else if (fft_solver) {
+    stats = fast->solve(f, u);
+  }
+  else {
+    stats = cg.solve(f, u);
+  }
+  double elapsed = MPI_Wtime() - t0;
+
+  manufactured::ErrorNorms err = sine ? manufactured::errors(u, hx, hy, MPI_COMM_WORLD)
+                                      : manufactured::errors(u, hx, hy, MPI_COMM_WORLD, [degree](double x, double y) {
+                                          return manufactured::exact_poly(x, y, degree);
+                                        });
+  if (rank == 0) {
+    const char *name = mg_solver ? "MG" : cheb_solver ? "Chebyshev" : pipe_solver ? "Pipelined CG"
+                       : fft_solver ? "FFT" : "CG";
+    std::printf("%s (%s, %s): %s after %d iterations, relative residual = %e, time = %.3f s\n",
+                mixed ? "Refinement" : name, mg_solver || cheb_solver || fft_solver ? "no preconditioner" : opt.precond.c_str(),
+                precision.c_str(), stats.converged ? "converged" : "NOT converged", stats.iterations, stats.residual,
+                elapsed);
+    if (mixed) std::printf("Inner float %s iterations: %d\n", name, inner_iterations);
+    std::printf("Global L2 error = %e\n", err.l2);
+    std::printf("Global L-infinity error = %e\n", err.linf);
+  }
+
+  // Collective write of the solution, every rank its own block
+  if (!output.empty()) {
+    fieldio::write(output, decomp, u, output_format);
+    if (rank == 0) {
+      std::printf("Solution written to %s (%s, %d x %d doubles)\n", output.c_str(),
+                  fieldio::use_hdf5(output, output_format) ? "HDF5" : "raw", decomp.Nx(), decomp.Ny());
+    }
+  }
+
+  profiler::finish(MPI_COMM_WORLD);
   MPI_Finalize();
   return 0;
 }
@@ -0,0 +1,149 @@
+#include <mpi.h>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include <utility>
+#include "decomp3d.hpp"
+#include "field3d.hpp"
+#include "haloExchange3d.hpp"
+#include "stencil3d.hpp"
+#include "convergence.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "config.hpp"
+
+
+// Usage: fd_test_decomp3d [--n=32] [--layout=block|pencil|slab] [--halo=packed|datatype] [--corners]
+//                         [--max_iter=100000] [--tolerance=1e-6] [--config=file]
+//        fd_test_decomp3d [n] [layout] [halo] [corners]      (positional form, see config.hpp)
+// Jacobi on -Laplacian u = 3 pi^2 sin(pi x) sin(pi y) sin(pi z) in the unit cube with u = 0 on
+// the boundary, on an N^3 grid. The halo exchange overlaps the update of the cells that do not
+// read ghost cells. Before solving, the ghost layers of a field of global indices are checked
+// (all 26 neighbours with corners, the 6 faces otherwise).
+int main(int argc, char** argv) {
+  parallel::init_mpi(&argc, &argv);
+
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  Config config(argc, argv, MPI_COMM_WORLD, {"n", "layout", "halo", "corners"});
+  const int N = config.get_int("n", 32);
+  const std::string layout_name = config.get_choice("layout", "block", {"block", "pencil", "slab"});
+  const Layout3D layout = layout_name == "slab" ? Layout3D::Slab
+                          : layout_name == "pencil" ? Layout3D::Pencil : Layout3D::Block;
+  const HaloMode mode = config.get_choice("halo", "packed", {"packed", "datatype"}) == "datatype"
+                            ? HaloMode::Datatype : HaloMode::Packed;
+  const bool corners = config.get_bool("corners", false);
+  const int max_iter = config.get_int("max_iter", 100000);
+  const double tolerance = config.get_double("tolerance", 1e-6);
+  config.check_unused();
+
+  Decomp3D decomp = Decomp3D::create(MPI_COMM_WORLD, N, N, N, 1, layout);
+  HaloExchange3D<float> halo(decomp, mode, corners);
+
+  const float h = 1.0 / (N - 1);
+  if (rank == 0) {
+    const char *names[] = {"block", "pencil", "slab"};
+    std::printf("%d MPI ranks x %d OpenMP threads\n", size, parallel::max_threads());
+    std::printf("N = %d | %s layout, Px Py Pz = %d %d %d | %s halo%s\n", N, names[static_cast<int>(layout)],
+                decomp.Px(), decomp.Py(), decomp.Pz(), mode == HaloMode::Datatype ? "datatype" : "packed",
+                corners ? " with corners" : "");
+  }
+
+  const int nx = decomp.nx(), ny = decomp.ny(), nz = decomp.nz();
+  Field3D<float> u(decomp), u_new(decomp), f(decomp);
+
+  // Halo check: every ghost cell inside the global grid must hold its global index
+  auto global_id = [N](int gi, int gj, int gk) { return static_cast<float>((gi * N + gj) * N + gk); };
+  for (int i = 0; i < nx; ++i)
+    for (int j = 0; j < ny; ++j)
+      for (int k = 0; k < nz; ++k)
+        u(i, j, k) = global_id(u.global_i(i), u.global_j(j), u.global_k(k));
+  halo.exchange(u);
+  long long mismatches = 0;
+  for (int i = -1; i <= nx; ++i) {
+    for (int j = -1; j <= ny; ++j) {
+      for (int k = -1; k <= nz; ++k) {
+        int outside = (i < 0 || i >= nx) + (j < 0 || j >= ny) + (k < 0 || k >= nz);
+        int gi = u.global_i(i), gj = u.global_j(j), gk = u.global_k(k);
+        bool in_grid = gi >= 0 && gi < N && gj >= 0 && gj < N && gk >= 0 && gk < N;
+        if (outside == 0 || !in_grid || (!corners && outside > 1)) continue;
+        if (u(i, j, k) != global_id(gi, gj, gk)) ++mismatches;
+      }
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &mismatches, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0) std::printf("Halo check: %lld wrong ghost cells\n", mismatches);
+  u.fill(0.0f);
+
+  for (int i = 0; i < nx; ++i) {
+    for (int j = 0; j < ny; ++j) {
+      for (int k = 0; k < nz; ++k) {
+        float x = f.global_i(i) * h, y = f.global_j(j) * h, z = f.global_k(k) * h;
+        f(i, j, k) = 3.0 * M_PI * M_PI * std::sin(M_PI * x) * std::sin(M_PI * y) * std::sin(M_PI * z);
+      }
+    }
+  }
+
+  const float inv_h2 = 1.0 / (h * h);
+  ConvergenceMonitor monitor(MPI_COMM_WORLD, tolerance, 10, ReduceMode::NonBlocking);
+
+  // Cells off the Dirichlet boundary; the inner box does not read ghost cells, the slabs
+  // around it are updated once the halo has arrived
+  const Box3D update = stencil::dirichlet_box(decomp);
+  const Box3D inner = update.intersect(u.interior().grow(-1));
+  Box3D slabs[6];
+  const int num_slabs = update.subtract(inner, slabs);
+
+  double t0 = MPI_Wtime();
+  int iterations = 0;
+  for (int iter = 0; iter < max_iter; ++iter) {
+    halo.begin(u);
+    float local_error;
+    {
+      PDE_PROFILE_SCOPE("jacobi.inner");
+      local_error = stencil::jacobi(u, f, u_new, inner, inv_h2, inv_h2, inv_h2);
+    }
+    halo.finish(u);
+    {
+      PDE_PROFILE_SCOPE("jacobi.slabs");
+      for (int s = 0; s < num_slabs; ++s) {
+        local_error = std::max(local_error, stencil::jacobi(u, f, u_new, slabs[s], inv_h2, inv_h2, inv_h2));
+      }
+    }
+    std::swap(u, u_new);
+    iterations = iter + 1;
+    if (monitor.check(iter, local_error)) break;
+  }
+  monitor.finish();
+  double elapsed = MPI_Wtime() - t0;
+
+  double local[2] = {0.0, 0.0}; // sum of squared errors, max error
+  for (int i = 0; i < nx; ++i) {
+    for (int j = 0; j < ny; ++j) {
+      for (int k = 0; k < nz; ++k) {
+        double x = u.global_i(i) * h, y = u.global_j(j) * h, z = u.global_k(k) * h;
+        double e = std::abs(u(i, j, k) - std::sin(M_PI * x) * std::sin(M_PI * y) * std::sin(M_PI * z));
+        local[0] += e * e;
+        local[1] = std::max(local[1], e);
+      }
+    }
+  }
+  double l2 = 0.0, linf = 0.0;
+  MPI_Allreduce(&local[0], &l2, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(&local[1], &linf, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    std::printf("%s after %d iterations (%.3f s), global error = %e\n",
+                monitor.converged() ? "Converged" : "NOT converged", iterations, elapsed, monitor.value());
+    std::printf("Global L2 error = %e\n", std::sqrt(l2 * h * h * h));
+    std::printf("Global L-infinity error = %e\n", linf);
+  }
+
+  profiler::finish(MPI_COMM_WORLD);
+  MPI_Finalize();
+  return 0;
+}